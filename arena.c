@@ -0,0 +1,127 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Arena allocator
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "memstat.h"
+
+#define ARENA_ALIGN 8
+
+struct Arena *ArenaCreate(size_t block_size) {
+
+    struct Arena *res = malloc(sizeof(struct Arena));
+    if (!res) {
+        printf("FATAL: Unable to allocate arena\n");
+        exit(1);
+    }
+
+    res->head = (struct ArenaBlock *) NULL;
+    res->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+    res->n_blocks = 0;
+    res->bytes = 0;
+    return res;
+}
+
+/*
+ * Returns size bytes from the arena, starting a new block when the
+ * current one is full.  Objects larger than a block get their own block.
+ */
+void *ArenaAlloc(struct Arena *a, size_t size) {
+
+    struct ArenaBlock *blk;
+    size_t blk_size;
+    void *res;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!a->head || a->head->used + size > a->head->size) {
+        blk_size = (size > a->block_size) ? size : a->block_size;
+        blk = malloc(sizeof(struct ArenaBlock) + blk_size);
+        if (!blk) {
+            MemFatal("arena block");
+        }
+        blk->next = a->head;
+        blk->used = 0;
+        blk->size = blk_size;
+        a->head = blk;
+        a->n_blocks++;
+
+        if (a->block_size < ARENA_BLOCK_SIZE) {
+            a->block_size = (2 * a->block_size < ARENA_BLOCK_SIZE) ? 2 * a->block_size : ARENA_BLOCK_SIZE;
+        }
+    }
+
+    res = a->head->data + a->head->used;
+    a->head->used += size;
+    a->bytes += size;
+    return res;
+}
+
+/*
+ * Frees every object allocated from the arena, and the arena itself
+ */
+void ArenaFree(struct Arena *a) {
+
+    struct ArenaBlock *blk, *next;
+
+    if (!a) return;
+
+    for (blk = a->head; blk; blk = next) {
+        next = blk->next;
+        free(blk);
+    }
+    free(a);
+}
+
+/*
+ * Moves every block of src into dst and frees src.  Objects allocated
+ * from src stay valid and are freed with dst.  dst keeps filling its
+ * current block.
+ */
+void ArenaMerge(struct Arena *dst, struct Arena *src) {
+
+    struct ArenaBlock *last;
+
+    if (!src) return;
+
+    if (src->head) {
+        for (last = src->head; last->next; last = last->next);
+        if (dst->head) {
+            last->next = dst->head->next;
+            dst->head->next = src->head;
+        } else {
+            dst->head = src->head;
+        }
+    }
+    dst->n_blocks += src->n_blocks;
+    dst->bytes += src->bytes;
+    free(src);
+}
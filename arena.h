@@ -0,0 +1,65 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1 << 20) /* default bytes per arena block */
+
+/*
+ * Bump allocator for the many small objects of a raster or index.
+ * Objects are carved out of large blocks and can only be freed
+ * all at once with ArenaFree.  Not thread safe.
+ *
+ * An arena created with a block size below ARENA_BLOCK_SIZE, sized for
+ * a small structure, doubles its block size with every new block up to
+ * ARENA_BLOCK_SIZE, so an underestimate costs few extra blocks.
+ */
+
+struct ArenaBlock {
+
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct Arena {
+
+    struct ArenaBlock *head;  /* block currently being filled */
+    size_t block_size;        /* size of the next block */
+    unsigned long n_blocks;
+    unsigned long bytes;      /* bytes handed out */
+};
+
+struct Arena *ArenaCreate(size_t block_size);
+void         *ArenaAlloc(struct Arena *a, size_t size);
+void          ArenaFree(struct Arena *a);
+void          ArenaMerge(struct Arena *dst, struct Arena *src);
+
+#endif
@@ -0,0 +1,121 @@
+#!/bin/sh
+#
+# GNATFinder benchmark suite
+#
+# Builds gnatfinder, gnat1 and gnatgen from this tree, generates a fixed
+# matrix of workloads and runs every engine and gnat1 on each of them.
+# Each run writes its per phase stats with -j; they are collected with the
+# workload parameters into one JSON file.
+#
+# The matrix varies one parameter at a time around a baseline, so each
+# parameter's effect can be read off on its own.  Seeds are fixed, so the
+# results of different commits can be compared run by run.
+#
+# Usage: ./bench.sh [results.json]
+#
+# Environment:
+#   WORK     scratch directory (default bench_work)
+#   ENGINES  gnatfinder engines to run (default "qtree lqtree pairfree selfjoin")
+#   THREADS  gnatfinder search threads (default 1)
+#   GNAT1    set to 0 to skip gnat1
+#   PERF     set to 1 to add hardware counters to every run
+#   CC, CXX  compilers (default gcc, g++)
+#
+
+set -e
+
+OUT=${1:-bench_results.json}
+WORK=${WORK:-bench_work}
+ENGINES=${ENGINES:-"qtree lqtree pairfree selfjoin"}
+THREADS=${THREADS:-1}
+GNAT1=${GNAT1:-1}
+PERF=${PERF:-0}
+CC=${CC:-gcc}
+CXX=${CXX:-g++}
+
+SRC=$(cd "$(dirname "$0")" && pwd)
+mkdir -p "$WORK/bin" "$WORK/data" "$WORK/runs"
+WORK=$(cd "$WORK" && pwd)
+BIN="$WORK/bin"
+
+# baseline workload: <cells> <duration> <rate> <synapses per cell> <tau> <thresh> <causal radius>
+BASE="500 10000 10 10 5 4 20"
+
+# one line per workload: the baseline with one parameter changed
+matrix() {
+    echo "$BASE"
+    for v in 5 20;   do echo "500 10000 $v 10 5 4 20"; done
+    for v in 250 1000; do echo "$v 10000 10 10 5 4 20"; done
+    for v in 2 10;   do echo "500 10000 10 10 $v 4 20"; done
+    for v in 2 6;    do echo "500 10000 10 10 5 $v 20"; done
+    for v in 10 40;  do echo "500 10000 10 10 5 4 $v"; done
+}
+
+echo "Building in $BIN"
+(cd "$SRC" &&
+ $CC -O2 -o "$BIN/gnatfinder" gnatfinder.c quadtree.c raster.c network.c gnats.c worksteal.c lqtree.c gnatbatch.c \
+     arena.c edgefile.c wcc.c spikefile.c gnatcache.c phasestats.c perfcount.c memstat.c trace.c -lm -lpthread &&
+ $CC -O2 -o "$BIN/gnatgen" gnatgen.c -lm &&
+ $CC -O2 -c spikefile.c -o "$BIN/spikefile.o" &&
+ $CC -O2 -c gnatcache.c -o "$BIN/gnatcache.o" &&
+ $CC -O2 -c phasestats.c -o "$BIN/phasestats.o" &&
+ $CC -O2 -c perfcount.c -o "$BIN/perfcount.o" &&
+ $CC -O2 -c memstat.c -o "$BIN/memstat.o" &&
+ $CXX -std=c++11 -O2 -o "$BIN/gnat1" compute_activity_threads.cpp \
+     "$BIN/spikefile.o" "$BIN/gnatcache.o" "$BIN/phasestats.o" "$BIN/perfcount.o" \
+     "$BIN/memstat.o")
+
+PERF_OPT=
+if [ "$PERF" != 0 ]; then
+    PERF_OPT=-P
+    export GNAT_PERF=1
+fi
+
+COMMIT=$(cd "$SRC" && git rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+# appends one run to the results: <workload json> <label> <stats file>
+N_RUNS=0
+add_run() {
+    if [ $N_RUNS -gt 0 ]; then printf ',\n' >> "$OUT.tmp"; fi
+    printf '    {"workload": %s, "run": "%s", "stats": ' "$1" "$2" >> "$OUT.tmp"
+    cat "$3" >> "$OUT.tmp"
+    printf '    }' >> "$OUT.tmp"
+    N_RUNS=$((N_RUNS + 1))
+}
+
+printf '{\n  "commit": "%s",\n  "threads": %s,\n  "runs": [\n' "$COMMIT" "$THREADS" > "$OUT.tmp"
+
+matrix | while read -r cells dur rate k tau thresh radius; do
+
+    # inputs only depend on the generator parameters
+    data="$WORK/data/n${cells}_T${dur}_r${rate}_k${k}"
+    if [ ! -f "$data.act" ]; then
+        "$BIN/gnatgen" -s 1 -n "$cells" -T "$dur" -r "$rate" -k "$k" -p 4 -L 4 -R 8 \
+            "$data.act" "$data.net" "$data.pat" > /dev/null
+    fi
+
+    wl=$(printf '{"n_cells": %s, "duration": %s, "rate": %s, "synapses_per_cell": %s, "tau": %s, "thresh": %s, "causal_radius": %s}' \
+         "$cells" "$dur" "$rate" "$k" "$tau" "$thresh" "$radius")
+    tag="n${cells}_r${rate}_tau${tau}_th${thresh}_cr${radius}"
+
+    for e in $ENGINES; do
+        echo "gnatfinder -e $e $tag"
+        stats="$WORK/runs/${tag}_$e.json"
+        (cd "$WORK/runs" && "$BIN/gnatfinder" -e "$e" -t "$THREADS" $PERF_OPT -j "$stats.tmp" \
+             "$cells" "$data.act" "$data.net" "$tau" "$thresh" "$radius" > "${tag}_$e.log")
+        mv "$stats.tmp" "$stats"
+        add_run "$wl" "gnatfinder-$e" "$stats"
+    done
+
+    if [ "$GNAT1" != 0 ]; then
+        echo "gnat1 $tag"
+        stats="$WORK/runs/${tag}_gnat1.json"
+        (cd "$WORK/runs" && "$BIN/gnat1" "$cells" "$data.net" "$data.act" 1 gnat1_out.txt \
+             "$tau" "$thresh" "$radius" "$stats" > "${tag}_gnat1.log")
+        add_run "$wl" "gnat1" "$stats"
+    fi
+done
+
+printf '\n  ]\n}\n' >> "$OUT.tmp"
+mv "$OUT.tmp" "$OUT"
+echo "Results in $OUT"
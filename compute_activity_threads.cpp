@@ -28,9 +28,8 @@
  * Brad Theilman 2023
  */
 
-#include <set>
 #include <vector>
-#include <list>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -38,6 +37,10 @@
 #include <cmath>
 #include <stdlib.h>
 
+#include "spikefile.h"
+#include "gnatcache.h"
+#include "phasestats.h"
+
 #define TICKS_PER_MS 1000000
 #define GNATS 1
 #define CDH   2
@@ -56,6 +59,17 @@ double gamma(tstamp_t t1, tstamp_t t2, double weight, double delay, double tau)
 
 
 /**********************************************************/
+// A run of sorted spike times inside a raster, used in place
+struct SpikeSpan {
+    const tstamp_t *first;
+    const tstamp_t *last;
+
+    const tstamp_t *begin() const { return first; }
+    const tstamp_t *end() const { return last; }
+    bool empty() const { return first == last; }
+    size_t size() const { return last - first; }
+};
+
 class SpikeRaster {
     public:
         SpikeRaster(idx_t n_neurons);
@@ -63,34 +77,77 @@ class SpikeRaster {
 
         idx_t n_neurons;
         int read_event_file(std::string fname);
-        void get_spikes_in_range(std::list<tstamp_t>& res, idx_t neuron_idx, tstamp_t low, tstamp_t high);
-        std::vector< std::set<tstamp_t> > evtlist; // Vector of sets of spikes, one set for each neuron
+        int read_event_cache(std::string fname);
+        SpikeSpan spikes(idx_t neuron_idx) const;
+        idx_t n_spikes() const { return times.size(); }
+
+    private:
+        // The spikes of neuron i are times[offsets[i]] .. times[offsets[i + 1] - 1],
+        // sorted and without repeats
+        std::vector<idx_t> offsets;
+        std::vector<tstamp_t> times;
+
+        void place_spikes(const std::vector<uint32_t>& ids, const std::vector<tstamp_t>& ts);
+        void sort_neurons();
 };
 
-// Constructor: Initialize the event list by pushing back an empty list for each neuron
+// Constructor: every neuron starts with no spikes
 SpikeRaster::SpikeRaster(idx_t N) {
 
-    n_neurons = 0;
-    for (idx_t i = 0; i < N; ++i) {
-        std::set<tstamp_t> s;
-        evtlist.push_back(s);
-        n_neurons++;
-    }
+    n_neurons = N;
+    offsets.assign(N + 1, 0);
 }
 
-// This function populates the list res with spike times from neuron <neuron_idx> that fall within the time range
-// [low, high]
-void SpikeRaster::get_spikes_in_range(std::list<tstamp_t>& res, idx_t neuron_idx, tstamp_t low, tstamp_t high) {
-    
-    std::set<tstamp_t>::iterator it, itlow, ithigh;
+SpikeSpan SpikeRaster::spikes(idx_t neuron_idx) const {
+
+    SpikeSpan res;
+    res.first = times.data() + offsets[neuron_idx];
+    res.last = times.data() + offsets[neuron_idx + 1];
+    return res;
+}
 
-    itlow = evtlist[neuron_idx].lower_bound(low);
-    ithigh = evtlist[neuron_idx].upper_bound(high);
+// Groups the spikes ts[k] of neurons ids[k] by neuron with a counting sort,
+// keeping their order within each neuron
+void SpikeRaster::place_spikes(const std::vector<uint32_t>& ids, const std::vector<tstamp_t>& ts) {
 
-    for (it = itlow; it != ithigh; ++it) {
-        res.push_back(*it);
+    std::vector<idx_t> next;
+
+    offsets.assign(n_neurons + 1, 0);
+    for (size_t k = 0; k < ids.size(); ++k) {
+        offsets[ids[k] + 1]++;
+    }
+    for (idx_t i = 0; i < n_neurons; ++i) {
+        offsets[i + 1] += offsets[i];
     }
 
+    times.resize(ts.size());
+    next.assign(offsets.begin(), offsets.end() - 1);
+    for (size_t k = 0; k < ids.size(); ++k) {
+        times[next[ids[k]]++] = ts[k];
+    }
+}
+
+// Sorts the spikes of each neuron and drops repeated times, compacting the arrays
+void SpikeRaster::sort_neurons() {
+
+    idx_t out = 0;
+
+    for (idx_t i = 0; i < n_neurons; ++i) {
+        tstamp_t *first = times.data() + offsets[i];
+        tstamp_t *last = times.data() + offsets[i + 1];
+
+        if (!std::is_sorted(first, last)) {
+            std::sort(first, last);
+        }
+        last = std::unique(first, last);
+        if (times.data() + out != first) {
+            std::copy(first, last, times.data() + out);
+        }
+        offsets[i] = out;
+        out += last - first;
+    }
+    offsets[n_neurons] = out;
+    times.resize(out);
 }
 
 // Reads spikes from a text file
@@ -100,35 +157,65 @@ void SpikeRaster::get_spikes_in_range(std::list<tstamp_t>& res, idx_t neuron_idx
 // timestamp is specified in a hexadecimal string
 int SpikeRaster::read_event_file(std::string fname) {
 
-    int evttype;
-    tstamp_t evtstamp;
-    idx_t evtidx;
-    
-    // Check that file exists
-    // try opening file
-    std::ifstream infile;
-    std::string line;
+    SpikeFile sf;
+    std::vector<SpikeRecord> recs(SPIKE_BATCH);
+    std::vector<uint32_t> ids;
+    std::vector<tstamp_t> ts;
+    const char *pos, *released;
+    size_t n;
+    bool stop = false;
 
-    infile.open(fname.c_str(), std::ifstream::in);
-    if (!infile.is_open()) {
+    // Map the file; spikefile.c does the parsing
+    if (SpikeFileOpen(&sf, fname.c_str())) {
         std::cout << "Error opening event file\n";
         exit(EXIT_FAILURE);
         return -1;
-    } else { 
-        std::cout << "Opened file: " << fname << "\n";
-        while(std::getline(infile, line)) {
-            std::istringstream iss(line);
-            //std::cout << "Processing line: " << line << "\n";
-            iss >> evttype >> std::hex >> evtstamp >> std::dec >> evtidx;
-            if (evtidx > n_neurons) {
+    }
+    std::cout << "Opened file: " << fname << "\n";
+
+    pos = released = sf.data;
+    while (!stop && (n = SpikeParse(&pos, sf.data + sf.size, recs.data(), recs.size())) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            if (recs[i].n_id >= n_neurons) {
                 std::cout << "Neuron index of event greater than number of neurons; ignoring..\n";
+                stop = true;
                 break;
             }
-            if (evttype == 0) {
-                evtlist[evtidx].insert(evtstamp);
+            if (recs[i].type == 0) {
+                ids.push_back(recs[i].n_id);
+                ts.push_back(recs[i].ts);
             }
         }
+        SpikeFileRelease(&sf, &released, pos);
     }
+    SpikeFileClose(&sf);
+
+    place_spikes(ids, ts);
+    sort_neurons();
+    return 0;
+}
+
+// Loads spikes from the binary cache gnatfinder -c writes next to an event file
+// Returns -1 if there is no up to date cache, or if it holds events other than
+// spikes, which this reader drops
+int SpikeRaster::read_event_cache(std::string fname) {
+
+    RasterCache rc;
+
+    if (RasterCacheMap(&rc, fname.c_str(), n_neurons)) {
+        return -1;
+    }
+    if (rc.hdr->n_typed > 0) {
+        RasterCacheUnmap(&rc);
+        return -1;
+    }
+    std::cout << "Opened cache of file: " << fname << "\n";
+
+    // times are already grouped and sorted per neuron
+    offsets.assign(rc.offsets, rc.offsets + n_neurons + 1);
+    times.assign(rc.times, rc.times + rc.offsets[n_neurons]);
+    RasterCacheUnmap(&rc);
+    sort_neurons();
     return 0;
 }
 /**********************************************************/
@@ -143,12 +230,17 @@ struct edge {
 
 class Network {
     public:
-        Network(idx_t _n_neurons) {this->n_neurons = _n_neurons;};
+        Network(idx_t _n_neurons) {this->n_neurons = _n_neurons; n_candidates = 0; n_emitted = 0;};
         ~Network() {};
 
         int read_connectivity_csr(std::string fname);
         int read_connectivity(std::string fname);
-        int compute_activity_threads(SpikeRaster& raster, std::string fname, double gamma_thresh, double temporal_radius, double tau, int func);
+        int read_connectivity_cache(std::string fname);
+        int compute_activity_threads(const SpikeRaster& raster, std::string fname, double gamma_thresh, double temporal_radius, double tau, int func);
+
+        idx_t n_synapses();
+        uint64_t n_candidates; // presynaptic spikes tested
+        uint64_t n_emitted;    // edges emitted
 
     private:
         // For each neuron, we have a list of presynaptic edges
@@ -156,7 +248,12 @@ class Network {
         idx_t n_neurons;
         std::vector<std::vector<struct edge> > presynaptic_edges;
 
-        void emit_causal_neighbors(SpikeRaster& sr, idx_t neuron_idx, double gamma_thresh, double temporal_radius, double tau, int func, std::ofstream& outfile);
+        // presynaptic spikes in the causal window of the current postsynaptic
+        // spike, one window per synapse, and where each presynaptic train ends
+        std::vector<SpikeSpan> windows;
+        std::vector<const tstamp_t *> train_ends;
+
+        void emit_causal_neighbors(const SpikeRaster& sr, idx_t neuron_idx, double gamma_thresh, double temporal_radius, double tau, int func, std::ofstream& outfile);
 };
 
 
@@ -239,9 +336,45 @@ int Network::read_connectivity(std::string fname) {
     return 0;
 }
 
+// Loads connectivity from the binary cache gnatfinder -c writes next to a
+// connectivity file; synapses keep their file order
+// Returns -1 if there is no up to date cache
+int Network::read_connectivity_cache(std::string fname) {
+
+    NetworkCache nc;
+
+    if (NetworkCacheMap(&nc, fname.c_str(), n_neurons)) {
+        return -1;
+    }
+    std::cout << "Opened cache of connectivity file: " << fname << "\n";
+
+    presynaptic_edges.resize(n_neurons);
+    for (idx_t cell_idx = 0; cell_idx < n_neurons; ++cell_idx) {
+        presynaptic_edges[cell_idx].reserve(nc.offsets[cell_idx + 1] - nc.offsets[cell_idx]);
+        for (uint64_t pos = nc.offsets[cell_idx]; pos < nc.offsets[cell_idx + 1]; ++pos) {
+            struct edge edg;
+            edg.idx = nc.src_id[pos];
+            edg.weight = nc.text_weight[pos];
+            edg.delay = nc.text_delay[pos];
+            presynaptic_edges[cell_idx].push_back(edg);
+        }
+    }
+    NetworkCacheUnmap(&nc);
+    return 0;
+}
+
+idx_t Network::n_synapses() {
+
+    idx_t n = 0;
+    for (idx_t cell_idx = 0; cell_idx < presynaptic_edges.size(); ++cell_idx) {
+        n += presynaptic_edges[cell_idx].size();
+    }
+    return n;
+}
+
 // For each neuron in the network, compute the causal neighbors and write these to the file
 // specified by filename
-int Network::compute_activity_threads(SpikeRaster& raster, std::string fname, double gamma_thresh, double temporal_radius, double tau, int func) {
+int Network::compute_activity_threads(const SpikeRaster& raster, std::string fname, double gamma_thresh, double temporal_radius, double tau, int func) {
 
     if (n_neurons < raster.n_neurons) {
         std::cout << "Number of neurons in connectivity file is less than the number of neurons in the raster\n";
@@ -270,17 +403,28 @@ int Network::compute_activity_threads(SpikeRaster& raster, std::string fname, do
 // computes all the causal neighbors of each spike emitted by neuron_idx
 // outputs directed edges as lines in the ofstream outfile
 // each line consists of <presynaptic_neuron_idx> <presynaptic_spike_time> <postsynaptic_neuron_idx> <postsynaptic_spike_time>
-void Network::emit_causal_neighbors(SpikeRaster& sr, idx_t neuron_idx, double gamma_thresh, double temporal_radius, double tau, int func, std::ofstream& outfile) {
+//
+// The postsynaptic spikes are visited in time order, so the window of each
+// synapse only ever moves forward through its presynaptic train
+void Network::emit_causal_neighbors(const SpikeRaster& sr, idx_t neuron_idx, double gamma_thresh, double temporal_radius, double tau, int func, std::ofstream& outfile) {
+
+    const std::vector<struct edge>& edges = presynaptic_edges[neuron_idx];
 
     // get spike train from this neuron
-    std::set<tstamp_t> postsyn_neuron_spikes = sr.evtlist[neuron_idx];
+    SpikeSpan postsyn_neuron_spikes = sr.spikes(neuron_idx);
+
+    // every window starts empty at the first presynaptic spike
+    windows.resize(edges.size());
+    train_ends.resize(edges.size());
+    for (idx_t presyn_idx = 0; presyn_idx < edges.size(); ++presyn_idx) {
+        SpikeSpan train = sr.spikes(edges[presyn_idx].idx);
+        windows[presyn_idx].first = windows[presyn_idx].last = train.first;
+        train_ends[presyn_idx] = train.last;
+    }
 
     // for each spike, find all spikes from presynaptic neurons within temporal radius
     //
-    std::set<tstamp_t>::iterator curr_spike;
-    for (curr_spike = postsyn_neuron_spikes.begin(); curr_spike != postsyn_neuron_spikes.end(); ++curr_spike) {
-
-        std::list<tstamp_t> pre_spikes;
+    for (const tstamp_t *curr_spike = postsyn_neuron_spikes.begin(); curr_spike != postsyn_neuron_spikes.end(); ++curr_spike) {
 
         // past_limit is the earliest spike time we consider
         // clamp to zero so that we don't go past start of recording
@@ -288,35 +432,42 @@ void Network::emit_causal_neighbors(SpikeRaster& sr, idx_t neuron_idx, double ga
         past_limit = (*curr_spike > temporal_radius) ? (*curr_spike - temporal_radius) : 0;
 
         // loop over presynaptic neurons
-        for (idx_t presyn_idx = 0; presyn_idx < presynaptic_edges[neuron_idx].size(); ++presyn_idx) { 
+        for (idx_t presyn_idx = 0; presyn_idx < edges.size(); ++presyn_idx) { 
 
             real_t weight, delay;
             idx_t presyn_neuron_idx;
+            SpikeSpan& pre_spikes = windows[presyn_idx];
+            const tstamp_t *train_end = train_ends[presyn_idx];
 
-            presyn_neuron_idx = presynaptic_edges[neuron_idx][presyn_idx].idx;
-            weight = presynaptic_edges[neuron_idx][presyn_idx].weight;
-            delay = presynaptic_edges[neuron_idx][presyn_idx].delay; 
-
-            // get all spikes within temporal radius from this presynaptic neuron
-            pre_spikes.clear();
-            sr.get_spikes_in_range(pre_spikes, presyn_neuron_idx, past_limit, *curr_spike);
+            presyn_neuron_idx = edges[presyn_idx].idx;
+            weight = edges[presyn_idx].weight;
+            delay = edges[presyn_idx].delay; 
 
-            std::list<tstamp_t>::iterator pre_spike;
-            if (!pre_spikes.empty()) {
+            // move the window to the spikes in [past_limit, curr_spike]
+            while (pre_spikes.first != train_end && *pre_spikes.first < past_limit) {
+                ++pre_spikes.first;
+            }
+            if (pre_spikes.last < pre_spikes.first) {
+                pre_spikes.last = pre_spikes.first;
+            }
+            while (pre_spikes.last != train_end && *pre_spikes.last <= *curr_spike) {
+                ++pre_spikes.last;
+            }
 
-                // loop over all presynaptic spikes from this presynaptic neuron
-                for (pre_spike = pre_spikes.begin(); pre_spike != pre_spikes.end(); ++pre_spike) {
+            // loop over all presynaptic spikes from this presynaptic neuron
+            for (const tstamp_t *pre_spike = pre_spikes.begin(); pre_spike != pre_spikes.end(); ++pre_spike) {
 
-                    double g;
+                double g;
 
-                    g = gamma(*pre_spike, *curr_spike, weight, delay, tau);
-                    // check for causality
-                    if (g <= gamma_thresh && func == GNATS) {
-                        // emit edge
-                        outfile << presyn_neuron_idx << " " << (tstamp_t)*pre_spike << " " << neuron_idx << " " << (tstamp_t)*curr_spike << "\n";
-                    } else if (func == CDH) {
-                        outfile << g << "\n";
-                    }
+                g = gamma(*pre_spike, *curr_spike, weight, delay, tau);
+                n_candidates++;
+                // check for causality
+                if (g <= gamma_thresh && func == GNATS) {
+                    // emit edge
+                    n_emitted++;
+                    outfile << presyn_neuron_idx << " " << (tstamp_t)*pre_spike << " " << neuron_idx << " " << (tstamp_t)*curr_spike << "\n";
+                } else if (func == CDH) {
+                    outfile << g << "\n";
                 }
             }
         }
@@ -332,8 +483,8 @@ int main(int argc, char *argv[]) {
     double gamma_thresh = 4;
     double temporal_radius = 100;
     double tau = 5;
-    if (argc != 9) {
-        std::cout << "usage: " << argv[0] << " <n_neurons> <connection_file> <spike_file> <func> <out_file> <tau> <thresh> <causal_radius>\n";
+    if (argc != 9 && argc != 10) {
+        std::cout << "usage: " << argv[0] << " <n_neurons> <connection_file> <spike_file> <func> <out_file> <tau> <thresh> <causal_radius> [stats.json]\n";
         std::cout << "func = 1 | Compute GNATS\nfunc = 2 | Compute causal distances\n";
     } else {
 
@@ -341,17 +492,51 @@ int main(int argc, char *argv[]) {
         gamma_thresh = std::stod(argv[7]);
         temporal_radius = std::stod(argv[8]); 
 
+        // hardware counters per phase, printed and added to the stats
+        bool use_perf = getenv("GNAT_PERF") && !PerfEnable();
+
+        PhaseBegin(PHASE_PARSE);
         std::cout << "Reading event file...\n";
         SpikeRaster raster = SpikeRaster(std::stoi(argv[1]));
-        raster.read_event_file(argv[3]);
+        if (raster.read_event_cache(argv[3])) {
+            raster.read_event_file(argv[3]);
+        }
 
         std::cout << "Reading connectivity file...\n";
         Network net = Network(std::stoi(argv[1]));
-        net.read_connectivity(argv[2]);
+        if (net.read_connectivity_cache(argv[2])) {
+            net.read_connectivity(argv[2]);
+        }
+        PhaseEnd(PHASE_PARSE);
 
         std::cout << "Computing activity threads...\n";
+        PhaseBegin(PHASE_SEARCH);
         net.compute_activity_threads(raster, argv[5], gamma_thresh, temporal_radius, tau, std::stoi(argv[4]));
+        PhaseEnd(PHASE_SEARCH);
         std::cout << "Done\n";
+        if (use_perf) {
+            PhaseStatsPrint();
+        }
+
+        if (argc == 10) {
+            // edges are written as they are found
+            g_phases[PHASE_SEARCH].candidates = net.n_candidates;
+            g_phases[PHASE_SEARCH].edges = net.n_emitted;
+
+            std::string n_spikes_str = std::to_string(raster.n_spikes());
+            std::string n_syns_str = std::to_string(net.n_synapses());
+
+            PhaseInfo("n_cells", argv[1]);
+            PhaseInfo("spike_file", argv[3]);
+            PhaseInfo("network_file", argv[2]);
+            PhaseInfo("func", argv[4]);
+            PhaseInfo("tau", argv[6]);
+            PhaseInfo("thresh", argv[7]);
+            PhaseInfo("causal_radius", argv[8]);
+            PhaseInfo("n_spikes", n_spikes_str.c_str());
+            PhaseInfo("n_synapses", n_syns_str.c_str());
+            PhaseStatsWrite(argv[9], "gnat1");
+        }
     }
 
     return 0;
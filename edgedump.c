@@ -0,0 +1,67 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Prints a binary edge file in the text format of gnat2_out.txt,
+ * followed by the two gamma values when the file has them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "edgefile.h"
+
+int main(int argc, char **argv) {
+
+    struct EdgeFile *ef;
+    const struct EdgeRecord *rec;
+    const struct EdgeRecordGamma *g;
+    uint64_t idx;
+
+    if (argc < 2) {
+        printf("Usage: %s <edge file>\n", argv[0]);
+        exit(-1);
+    }
+
+    ef = EdgeFileOpen(argv[1]);
+    if (!ef) {
+        exit(-1);
+    }
+
+    for (idx = 0; idx < ef->n_edges; ++idx) {
+        rec = EdgeFileRecord(ef, idx);
+        printf("%" PRIu32 " %" PRId64 " %" PRId64 " %" PRIu32 " %" PRId64 " %" PRId64,
+               rec->pre_id, rec->t_pre1, rec->t_pre2, rec->post_id, rec->t_post1, rec->t_post2);
+        g = EdgeFileGamma(ef, idx);
+        if (g) {
+            printf(" %g %g", g->gamma1, g->gamma2);
+        }
+        printf("\n");
+    }
+
+    EdgeFileClose(ef);
+    return 0;
+}
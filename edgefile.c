@@ -0,0 +1,163 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Binary edge file writer and memory mapped reader
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "edgefile.h"
+
+uint32_t EdgeFileRecordSize(uint32_t flags) {
+
+    return (flags & EDGEFILE_GAMMA) ? sizeof(struct EdgeRecordGamma) : sizeof(struct EdgeRecord);
+}
+
+/*
+ * Writes the header of a new edge file.  The edge count is left
+ * unfinished until EdgeFileFinish.
+ */
+void EdgeFileWriteHeader(FILE *fp, uint32_t flags) {
+
+    struct EdgeFileHeader hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EDGEFILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = EDGEFILE_VERSION;
+    hdr.flags = flags;
+    hdr.header_size = sizeof(struct EdgeFileHeader);
+    hdr.record_size = EdgeFileRecordSize(flags);
+    hdr.n_edges = EDGEFILE_UNFINISHED;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        printf("FATAL: Unable to write edge file header\n");
+        exit(-1);
+    }
+}
+
+/*
+ * Records the final edge count in the header
+ */
+void EdgeFileFinish(FILE *fp, uint64_t n_edges) {
+
+    if (fseek(fp, offsetof(struct EdgeFileHeader, n_edges), SEEK_SET) ||
+        fwrite(&n_edges, sizeof(n_edges), 1, fp) != 1) {
+        printf("FATAL: Unable to finish edge file\n");
+        exit(-1);
+    }
+    fseek(fp, 0, SEEK_END);
+}
+
+/*
+ * Maps edge file fname read only.  Returns NULL with a message if the
+ * file cannot be opened or is not a supported edge file.  A file that
+ * was never finished is read up to its last complete record.
+ */
+struct EdgeFile *EdgeFileOpen(const char *fname) {
+
+    struct EdgeFile *ef;
+    struct stat st;
+    void *map;
+    uint64_t n_max;
+    int fd;
+
+    fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: Unable to open edge file %s\n", fname);
+        return (struct EdgeFile *) NULL;
+    }
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct EdgeFileHeader)) {
+        printf("ERROR: %s is not an edge file\n", fname);
+        close(fd);
+        return (struct EdgeFile *) NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("ERROR: Unable to map edge file %s\n", fname);
+        close(fd);
+        return (struct EdgeFile *) NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    ef = malloc(sizeof(struct EdgeFile));
+    if (!ef) {
+        printf("FATAL: Unable to allocate edge file\n");
+        exit(-1);
+    }
+    ef->fd = fd;
+    ef->size = st.st_size;
+    ef->map = map;
+    ef->hdr = (const struct EdgeFileHeader *) map;
+
+    if (memcmp(ef->hdr->magic, EDGEFILE_MAGIC, sizeof(ef->hdr->magic))) {
+        printf("ERROR: %s is not an edge file\n", fname);
+        EdgeFileClose(ef);
+        return (struct EdgeFile *) NULL;
+    }
+    if (ef->hdr->version != EDGEFILE_VERSION) {
+        printf("ERROR: %s has unsupported version or byte order\n", fname);
+        EdgeFileClose(ef);
+        return (struct EdgeFile *) NULL;
+    }
+    if (ef->hdr->record_size != EdgeFileRecordSize(ef->hdr->flags) ||
+        ef->hdr->header_size < sizeof(struct EdgeFileHeader) || ef->hdr->header_size > ef->size) {
+        printf("ERROR: %s has a corrupt header\n", fname);
+        EdgeFileClose(ef);
+        return (struct EdgeFile *) NULL;
+    }
+
+    ef->flags = ef->hdr->flags;
+    ef->record_size = ef->hdr->record_size;
+    ef->records = ef->map + ef->hdr->header_size;
+
+    n_max = (ef->size - ef->hdr->header_size) / ef->record_size;
+    ef->n_edges = ef->hdr->n_edges;
+    if (ef->n_edges == EDGEFILE_UNFINISHED) {
+        ef->n_edges = n_max;
+    } else if (ef->n_edges > n_max) {
+        printf("ERROR: %s is truncated\n", fname);
+        EdgeFileClose(ef);
+        return (struct EdgeFile *) NULL;
+    }
+    return ef;
+}
+
+void EdgeFileClose(struct EdgeFile *ef) {
+
+    if (!ef) return;
+
+    munmap((void *) ef->map, ef->size);
+    close(ef->fd);
+    free(ef);
+}
@@ -0,0 +1,114 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef EDGEFILE_H
+#define EDGEFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary second order edge file
+ *
+ * A fixed size header is followed by n_edges fixed size records in the
+ * writer's native byte order.  Files written on a host of the other byte
+ * order are rejected because their version does not read back as
+ * EDGEFILE_VERSION.  With EDGEFILE_GAMMA set, every record is followed
+ * by the gamma of both pre -> post spike links.
+ */
+
+#define EDGEFILE_MAGIC "GNATEDGE"
+#define EDGEFILE_VERSION 1
+
+#define EDGEFILE_GAMMA 0x1 /* records carry gamma values */
+
+#define EDGEFILE_UNFINISHED UINT64_MAX /* n_edges of a file that was never finished */
+
+struct EdgeFileHeader {
+
+    char magic[8];        /* EDGEFILE_MAGIC, not NUL terminated */
+    uint32_t version;
+    uint32_t flags;
+    uint32_t header_size; /* offset of the first record */
+    uint32_t record_size; /* bytes per record */
+    uint64_t n_edges;
+};
+
+struct EdgeRecord {
+
+    uint32_t pre_id;
+    uint32_t post_id;
+    int64_t t_pre1;
+    int64_t t_pre2;
+    int64_t t_post1;
+    int64_t t_post2;
+};
+
+struct EdgeRecordGamma {
+
+    struct EdgeRecord e;
+    float gamma1; /* gamma of t_pre1 -> t_post1 */
+    float gamma2; /* gamma of t_pre2 -> t_post2 */
+};
+
+/*
+ * Read only view of an edge file mapped into memory
+ */
+struct EdgeFile {
+
+    int fd;
+    size_t size;
+    const unsigned char *map;
+    const struct EdgeFileHeader *hdr;
+    const unsigned char *records;
+    uint64_t n_edges;
+    uint32_t record_size;
+    uint32_t flags;
+};
+
+/* writing */
+void     EdgeFileWriteHeader(FILE *fp, uint32_t flags);
+void     EdgeFileFinish(FILE *fp, uint64_t n_edges);
+uint32_t EdgeFileRecordSize(uint32_t flags);
+
+/* reading */
+struct EdgeFile *EdgeFileOpen(const char *fname);
+void             EdgeFileClose(struct EdgeFile *ef);
+
+/* edge idx of an open file, 0 <= idx < ef->n_edges */
+static inline const struct EdgeRecord *EdgeFileRecord(const struct EdgeFile *ef, uint64_t idx) {
+
+    return (const struct EdgeRecord *)(ef->records + idx * ef->record_size);
+}
+
+/* gamma values of edge idx, NULL if the file has none */
+static inline const struct EdgeRecordGamma *EdgeFileGamma(const struct EdgeFile *ef, uint64_t idx) {
+
+    if (!(ef->flags & EDGEFILE_GAMMA)) return (const struct EdgeRecordGamma *) NULL;
+    return (const struct EdgeRecordGamma *)(ef->records + idx * ef->record_size);
+}
+
+#endif
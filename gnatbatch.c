@@ -0,0 +1,182 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Batch GNAT edge test kernels
+ *
+ * The kernels are compiled for their instruction set with target
+ * attributes and picked at run time, so no special compiler flags
+ * are needed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GNAT_BATCH_X86 1
+#endif
+
+#include "gnatbatch.h"
+
+/*
+ * Scalar test of pairs first .. n - 1, also used for the tails of the vector kernels
+ */
+static unsigned long batch_test_range(const uint32_t *t1, const uint32_t *t2, unsigned long first, unsigned long n,
+                                      uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                                      uint32_t *hits) {
+
+    unsigned long idx, n_hits = 0;
+
+    for (idx = first; idx < n; ++idx) {
+        /* unsigned wrap turns each two sided check into one compare */
+        hits[n_hits] = idx;
+        n_hits += ((uint32_t)(t1[idx] - x_lo) <= x_w) & ((uint32_t)(t2[idx] - y_lo) <= y_w);
+    }
+    return n_hits;
+}
+
+static unsigned long batch_test_scalar(const uint32_t *t1, const uint32_t *t2, unsigned long n,
+                                       uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                                       uint32_t *hits) {
+
+    return batch_test_range(t1, t2, 0, n, x_lo, x_w, y_lo, y_w, hits);
+}
+
+#ifdef GNAT_BATCH_X86
+
+__attribute__((target("avx2")))
+static unsigned long batch_test_avx2(const uint32_t *t1, const uint32_t *t2, unsigned long n,
+                                     uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                                     uint32_t *hits) {
+
+    __m256i v_xlo = _mm256_set1_epi32(x_lo);
+    __m256i v_xw  = _mm256_set1_epi32(x_w);
+    __m256i v_ylo = _mm256_set1_epi32(y_lo);
+    __m256i v_yw  = _mm256_set1_epi32(y_w);
+    __m256i dx, dy, ok;
+    unsigned long idx, n_hits = 0;
+    unsigned int mask;
+
+    for (idx = 0; idx + 8 <= n; idx += 8) {
+        dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)&t1[idx]), v_xlo);
+        dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)&t2[idx]), v_ylo);
+
+        /* d <= w (unsigned) exactly when min(d, w) == d */
+        ok = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_min_epu32(dx, v_xw), dx),
+                              _mm256_cmpeq_epi32(_mm256_min_epu32(dy, v_yw), dy));
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+
+        /* compact the passing lanes */
+        while (mask) {
+            hits[n_hits++] = idx + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+
+    return n_hits + batch_test_range(t1, t2, idx, n, x_lo, x_w, y_lo, y_w, &hits[n_hits]);
+}
+
+__attribute__((target("avx512f")))
+static unsigned long batch_test_avx512(const uint32_t *t1, const uint32_t *t2, unsigned long n,
+                                       uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                                       uint32_t *hits) {
+
+    __m512i v_xlo = _mm512_set1_epi32(x_lo);
+    __m512i v_xw  = _mm512_set1_epi32(x_w);
+    __m512i v_ylo = _mm512_set1_epi32(y_lo);
+    __m512i v_yw  = _mm512_set1_epi32(y_w);
+    __m512i v_idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i v_16  = _mm512_set1_epi32(16);
+    __m512i dx, dy;
+    __mmask16 ok;
+    unsigned long idx, n_hits = 0;
+
+    for (idx = 0; idx + 16 <= n; idx += 16) {
+        dx = _mm512_sub_epi32(_mm512_loadu_si512(&t1[idx]), v_xlo);
+        dy = _mm512_sub_epi32(_mm512_loadu_si512(&t2[idx]), v_ylo);
+
+        ok = _mm512_cmple_epu32_mask(dx, v_xw);
+        ok = _mm512_mask_cmple_epu32_mask(ok, dy, v_yw);
+
+        /* compact the indices of the passing lanes */
+        _mm512_mask_compressstoreu_epi32(&hits[n_hits], ok, v_idx);
+        n_hits += __builtin_popcount(ok);
+        v_idx = _mm512_add_epi32(v_idx, v_16);
+    }
+
+    return n_hits + batch_test_range(t1, t2, idx, n, x_lo, x_w, y_lo, y_w, &hits[n_hits]);
+}
+
+#endif
+
+GNATBatchFn GNAT_batch_test = batch_test_scalar;
+static const char *batch_name = "scalar";
+
+/*
+ * Selects the batch kernel.  Returns -1 if the requested kernel
+ * is not supported by this CPU.
+ */
+int GNAT_batch_init(enum GNATBatchKernel kernel) {
+
+#ifdef GNAT_BATCH_X86
+    __builtin_cpu_init();
+
+    if (kernel == BATCH_AUTO) {
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = BATCH_AVX512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = BATCH_AVX2;
+        } else {
+            kernel = BATCH_SCALAR;
+        }
+    }
+
+    if (kernel == BATCH_AVX512) {
+        if (!__builtin_cpu_supports("avx512f")) return -1;
+        GNAT_batch_test = batch_test_avx512;
+        batch_name = "avx512";
+        return 0;
+    }
+
+    if (kernel == BATCH_AVX2) {
+        if (!__builtin_cpu_supports("avx2")) return -1;
+        GNAT_batch_test = batch_test_avx2;
+        batch_name = "avx2";
+        return 0;
+    }
+#else
+    if (kernel == BATCH_AVX2 || kernel == BATCH_AVX512) return -1;
+#endif
+
+    GNAT_batch_test = batch_test_scalar;
+    batch_name = "scalar";
+    return 0;
+}
+
+const char *GNAT_batch_name(void) {
+
+    return batch_name;
+}
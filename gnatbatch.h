@@ -0,0 +1,60 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef GNATBATCH_H
+#define GNATBATCH_H
+
+#include <stdint.h>
+
+/*
+ * Batch GNAT edge test
+ *
+ * Tests a block of presynaptic spike pairs, stored as separate arrays of
+ * first and second spike times, against one post pair and synapse.
+ * Times are 32 bit offsets from a common origin.  A pair passes when
+ * x_lo <= t1 <= x_lo + x_w and y_lo <= t2 <= y_lo + y_w, which inside
+ * the synapse's causal window is the same as passing both gamma tests.
+ * The indices of the passing pairs are written to hits, in order, and
+ * their number is returned.  hits must have room for n entries.
+ */
+
+enum GNATBatchKernel {
+    BATCH_AUTO,   /* best kernel supported by the CPU */
+    BATCH_SCALAR,
+    BATCH_AVX2,   /* 8 pairs per instruction */
+    BATCH_AVX512  /* 16 pairs per instruction */
+};
+
+typedef unsigned long (*GNATBatchFn)(const uint32_t *t1, const uint32_t *t2, unsigned long n,
+                                     uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                                     uint32_t *hits);
+
+extern GNATBatchFn GNAT_batch_test;
+
+int         GNAT_batch_init(enum GNATBatchKernel kernel);
+const char *GNAT_batch_name(void);
+
+#endif
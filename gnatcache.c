@@ -0,0 +1,266 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Sidecar cache files
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gnatcache.h"
+
+void CacheName(const char *src_fname, char *buf, size_t len) {
+
+    snprintf(buf, len, "%s%s", src_fname, CACHE_SUFFIX);
+}
+
+/* fills the source fields of hdr from the text file; -1 if it cannot be read */
+static int cache_source(struct CacheHeader *hdr, const char *src_fname) {
+
+    struct stat st;
+
+    if (stat(src_fname, &st)) return -1;
+    hdr->src_size = st.st_size;
+    hdr->src_mtime_s = st.st_mtim.tv_sec;
+    hdr->src_mtime_ns = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/* size rounded up to the 8 byte alignment of every cache array */
+static size_t cache_pad(size_t size) {
+
+    return (size + 7) & ~(size_t)7;
+}
+
+static int cache_write_array(FILE *fp, const void *data, size_t size) {
+
+    static const char zeros[8];
+
+    if (size && fwrite(data, size, 1, fp) != 1) return -1;
+    if (cache_pad(size) > size && fwrite(zeros, cache_pad(size) - size, 1, fp) != 1) return -1;
+    return 0;
+}
+
+/*
+ * Writes hdr and the n_arrays arrays to the cache of src_fname.  The file
+ * is written under a temporary name and renamed, so a reader never sees a
+ * partial cache.
+ */
+static int cache_write(const char *src_fname, struct CacheHeader *hdr, int n_arrays, const void **arrays, const size_t *sizes) {
+
+    char fname[4096], tmp[4200];
+    FILE *fp;
+    int idx, err = 0;
+
+    if (cache_source(hdr, src_fname)) return -1;
+    hdr->version = CACHE_VERSION;
+    hdr->header_size = sizeof(struct CacheHeader);
+
+    CacheName(src_fname, fname, sizeof(fname));
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", fname, (int) getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp) return -1;
+
+    err |= cache_write_array(fp, hdr, sizeof(struct CacheHeader));
+    for (idx = 0; idx < n_arrays; ++idx) {
+        err |= cache_write_array(fp, arrays[idx], sizes[idx]);
+    }
+    err |= fclose(fp);
+    if (err || rename(tmp, fname)) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Maps the cache of src_fname if it exists, has the given magic and cell
+ * count, matches the text file, and holds the offsets and items_bytes(n_items)
+ * bytes of items.  The offsets must start at 0, never decrease and end at
+ * n_items, as they are used in place to index the items.  Returns -1
+ * otherwise.
+ */
+static int cache_map(const char *src_fname, const char *magic, uint64_t n_cells, size_t (*items_bytes)(uint64_t),
+                     void **map, size_t *size) {
+
+    char fname[4096];
+    struct CacheHeader src;
+    const struct CacheHeader *hdr;
+    const uint64_t *offsets;
+    struct stat st;
+    uint64_t idx;
+    int fd;
+
+    if (cache_source(&src, src_fname)) return -1;
+
+    CacheName(src_fname, fname, sizeof(fname));
+    fd = open(fname, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(struct CacheHeader)) {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*map == MAP_FAILED) return -1;
+
+    hdr = (const struct CacheHeader *) *map;
+    if (memcmp(hdr->magic, magic, sizeof(hdr->magic)) || hdr->version != CACHE_VERSION ||
+        hdr->header_size != sizeof(struct CacheHeader) || hdr->n_cells != n_cells ||
+        hdr->src_size != src.src_size || hdr->src_mtime_s != src.src_mtime_s || hdr->src_mtime_ns != src.src_mtime_ns ||
+        *size != sizeof(struct CacheHeader) + (n_cells + 1) * sizeof(uint64_t) + items_bytes(hdr->n_items)) {
+        munmap(*map, *size);
+        return -1;
+    }
+
+    offsets = (const uint64_t *)((const unsigned char *) *map + sizeof(struct CacheHeader));
+    for (idx = 0; idx < n_cells; ++idx) {
+        if (offsets[idx + 1] < offsets[idx]) break;
+    }
+    if (offsets[0] != 0 || idx < n_cells || offsets[n_cells] != hdr->n_items) {
+        munmap(*map, *size);
+        return -1;
+    }
+    return 0;
+}
+
+static size_t raster_items_bytes(uint64_t n_spikes) {
+
+    return n_spikes * sizeof(int64_t);
+}
+
+int RasterCacheWrite(const char *src_fname, uint64_t n_cells, uint64_t n_spikes, const uint64_t *offsets,
+                     const int64_t *times, uint64_t n_typed, int64_t t_min, int64_t t_max) {
+
+    struct CacheHeader hdr;
+    const void *arrays[2];
+    size_t sizes[2];
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC_RASTER, sizeof(hdr.magic));
+    hdr.n_cells = n_cells;
+    hdr.n_items = n_spikes;
+    hdr.n_typed = n_typed;
+    hdr.t_min = t_min;
+    hdr.t_max = t_max;
+
+    arrays[0] = offsets;
+    sizes[0] = (n_cells + 1) * sizeof(uint64_t);
+    arrays[1] = times;
+    sizes[1] = n_spikes * sizeof(int64_t);
+    return cache_write(src_fname, &hdr, 2, arrays, sizes);
+}
+
+int RasterCacheMap(struct RasterCache *rc, const char *src_fname, uint64_t n_cells) {
+
+    const unsigned char *p;
+
+    if (cache_map(src_fname, CACHE_MAGIC_RASTER, n_cells, raster_items_bytes, &rc->map, &rc->size)) return -1;
+
+    p = (const unsigned char *) rc->map;
+    rc->hdr = (const struct CacheHeader *) p;
+    rc->offsets = (const uint64_t *)(p + sizeof(struct CacheHeader));
+    rc->times = (const int64_t *)(rc->offsets + n_cells + 1);
+    return 0;
+}
+
+void RasterCacheUnmap(struct RasterCache *rc) {
+
+    munmap(rc->map, rc->size);
+    rc->map = NULL;
+}
+
+static size_t network_items_bytes(uint64_t n_syn) {
+
+    return cache_pad(n_syn * sizeof(uint32_t)) + 3 * cache_pad(n_syn * sizeof(float)) + 2 * n_syn * sizeof(double);
+}
+
+int NetworkCacheWrite(const char *src_fname, uint64_t n_cells, uint64_t n_syn, const uint64_t *offsets,
+                      const uint32_t *src_id, const float *delay, const float *neg_log_rel_w, const float *rel_w,
+                      const double *text_weight, const double *text_delay) {
+
+    struct CacheHeader hdr;
+    const void *arrays[7];
+    size_t sizes[7];
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC_NETWORK, sizeof(hdr.magic));
+    hdr.n_cells = n_cells;
+    hdr.n_items = n_syn;
+
+    arrays[0] = offsets;
+    sizes[0] = (n_cells + 1) * sizeof(uint64_t);
+    arrays[1] = src_id;
+    sizes[1] = n_syn * sizeof(uint32_t);
+    arrays[2] = delay;
+    sizes[2] = n_syn * sizeof(float);
+    arrays[3] = neg_log_rel_w;
+    sizes[3] = n_syn * sizeof(float);
+    arrays[4] = rel_w;
+    sizes[4] = n_syn * sizeof(float);
+    arrays[5] = text_weight;
+    sizes[5] = n_syn * sizeof(double);
+    arrays[6] = text_delay;
+    sizes[6] = n_syn * sizeof(double);
+    return cache_write(src_fname, &hdr, 7, arrays, sizes);
+}
+
+int NetworkCacheMap(struct NetworkCache *nc, const char *src_fname, uint64_t n_cells) {
+
+    const unsigned char *p;
+    uint64_t n_syn;
+
+    if (cache_map(src_fname, CACHE_MAGIC_NETWORK, n_cells, network_items_bytes, &nc->map, &nc->size)) return -1;
+
+    p = (const unsigned char *) nc->map;
+    nc->hdr = (const struct CacheHeader *) p;
+    n_syn = nc->hdr->n_items;
+    nc->offsets = (const uint64_t *)(p + sizeof(struct CacheHeader));
+    p = (const unsigned char *)(nc->offsets + n_cells + 1);
+    nc->src_id = (const uint32_t *) p;
+    p += cache_pad(n_syn * sizeof(uint32_t));
+    nc->delay = (const float *) p;
+    p += cache_pad(n_syn * sizeof(float));
+    nc->neg_log_rel_w = (const float *) p;
+    p += cache_pad(n_syn * sizeof(float));
+    nc->rel_w = (const float *) p;
+    p += cache_pad(n_syn * sizeof(float));
+    nc->text_weight = (const double *) p;
+    nc->text_delay = nc->text_weight + n_syn;
+    return 0;
+}
+
+void NetworkCacheUnmap(struct NetworkCache *nc) {
+
+    munmap(nc->map, nc->size);
+    nc->map = NULL;
+}
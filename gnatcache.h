@@ -0,0 +1,116 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GNATCACHE_H
+#define GNATCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary sidecar caches of the text inputs, shared by gnatfinder and gnat1.
+ *
+ * A cache is written next to its text file as <file>.gnatc and records the
+ * size and modification time of the text file, so a cache that no longer
+ * matches its source is ignored.  Arrays are padded to 8 bytes and in native
+ * byte order, so they are used in place from a read only mapping.
+ *
+ * Raster cache: spike times of cell i are times[offsets[i]] .. times[offsets[i+1] - 1],
+ * time sorted, duplicates kept.
+ *
+ * Network cache: CSR by target.  Synapses onto cell i are entries
+ * offsets[i] .. offsets[i+1] - 1 of the synapse arrays, in file order:
+ * src_id, delay, neg_log_rel_w and rel_w as gnatfinder's PhysNetwork holds
+ * them, then the weight and delay as parsed from the text, for gnat1.
+ */
+
+#define CACHE_MAGIC_RASTER  "GNATRAST"
+#define CACHE_MAGIC_NETWORK "GNATNETW"
+#define CACHE_VERSION 2
+#define CACHE_SUFFIX ".gnatc"
+
+struct CacheHeader {
+
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    /* source text file */
+    uint64_t src_size;
+    int64_t src_mtime_s;
+    int64_t src_mtime_ns;
+
+    uint64_t n_cells;
+    uint64_t n_items;   /* spikes or synapses */
+    uint64_t n_typed;   /* raster: spikes whose type was not 0 */
+    int64_t t_min;      /* raster only */
+    int64_t t_max;
+};
+
+struct RasterCache {
+
+    void *map;
+    size_t size;
+    const struct CacheHeader *hdr;
+    const uint64_t *offsets; /* n_cells + 1 */
+    const int64_t *times;    /* n_items */
+};
+
+struct NetworkCache {
+
+    void *map;
+    size_t size;
+    const struct CacheHeader *hdr;
+    const uint64_t *offsets;     /* n_cells + 1 */
+    const uint32_t *src_id;      /* n_items */
+    const float *delay;
+    const float *neg_log_rel_w;
+    const float *rel_w;
+    const double *text_weight;
+    const double *text_delay;
+};
+
+void CacheName(const char *src_fname, char *buf, size_t len);
+
+int  RasterCacheWrite(const char *src_fname, uint64_t n_cells, uint64_t n_spikes, const uint64_t *offsets,
+                      const int64_t *times, uint64_t n_typed, int64_t t_min, int64_t t_max);
+int  RasterCacheMap(struct RasterCache *rc, const char *src_fname, uint64_t n_cells);
+void RasterCacheUnmap(struct RasterCache *rc);
+
+int  NetworkCacheWrite(const char *src_fname, uint64_t n_cells, uint64_t n_syn, const uint64_t *offsets,
+                       const uint32_t *src_id, const float *delay, const float *neg_log_rel_w, const float *rel_w,
+                       const double *text_weight, const double *text_delay);
+int  NetworkCacheMap(struct NetworkCache *nc, const char *src_fname, uint64_t n_cells);
+void NetworkCacheUnmap(struct NetworkCache *nc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
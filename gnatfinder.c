@@ -31,11 +31,24 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
+#include "arena.h"
 #include "quadtree.h"
+#include "lqtree.h"
 #include "raster.h"
 #include "network.h"
 #include "gnats.h"
+#include "worksteal.h"
+#include "gnatbatch.h"
+#include "phasestats.h"
+#include "memstat.h"
+#include "trace.h"
+
+#define TASKS_PER_THREAD 16 /* target number of tasks per worker after splitting */
 
 /* global spike raster */
 struct SpikeRaster g_raster;
@@ -46,60 +59,294 @@ struct PhysNetwork g_network;
 /* global neuron quadtree array */
 struct QuadTree **g_qtarray;
 
-void compute_gnat_edges(float tau, float thresh, float c_radius) {
+/* per neuron arenas holding the quadtree nodes, boxes and pairs, NULL when using malloc */
+struct Arena **g_qtarenas;
+
+/* global neuron linear quadtree array */
+struct LQTree **g_lqtarray;
+
+/* spike pair index used by the search */
+enum GNATEngine {
+    ENGINE_QTREE,  /* pointer based quadtree */
+    ENGINE_LQTREE, /* linear (Morton ordered) quadtree */
+    ENGINE_PAIRFREE, /* no pair index, presynaptic pairs found from sorted spike times */
+    ENGINE_SELFJOIN  /* per synapse self-join of first order causal links */
+};
+
+/*
+ * Search parameters shared by all worker threads
+ */
+struct SearchParams {
+
+    float tau;
+    float thresh;
+    enum GNATEngine engine;
 
-    struct BoundingBox query_bbox;
+    struct Scheduler sched;
+};
+
+/*
+ * Arguments of a single search worker thread
+ */
+struct SearchWorker {
+
+    pthread_t thread;
+    int id;
+    struct SearchParams *sp;
+    struct QueryStats qs;
+};
+
+/*
+ * Finds all second order edges onto the postsynaptic cell of task t
+ * whose first post spike falls in the task's sp_a range.
+ * Edges are collected in the calling thread's edge buffer eb
+ */
+static void search_post_range(struct SearchTask *t, struct SearchParams *sp, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    struct QueryRange query;
     struct QuadTree *presyn_qtree;
-    struct Synapse *presyn;
+    struct Synapse syn, *presyn = &syn;
     struct Spike *sp_a, *sp_b;
-    struct SpikePair *spp_post;
+    struct SpikePair post_pair;
+    struct SpikePair *spp_post = &post_pair;
 
-    unsigned long tgt_id;
+    unsigned long tgt_id, n_a, pos;
 
-    unsigned int post_idx;
-    for (post_idx = 0; post_idx < g_network.n_cells; ++post_idx) {
+    tgt_id = t->post_idx;
+
+    /* iterate over spike pairs in post qtree */
+    sp_a = t->sp_first;
+    for (n_a = 0; n_a < t->n_a; ++n_a) {
+        sp_b = sp_a->next;
+        while(sp_b) {
+            if (!spike_equals(sp_a, sp_b)) {
+                /* edges copy the spike times, so the post pair can live on the stack */
+                post_pair.sp1 = sp_a;
+                post_pair.sp2 = sp_b;
+                post_pair.prev = (struct SpikePair *) NULL;
+                post_pair.next = (struct SpikePair *) NULL;
+                //print_spike_pair(spp_post);
+
+                /* presynaptic partners, contiguous in the network arrays */
+                for (pos = g_network.offsets[tgt_id]; pos < g_network.offsets[tgt_id + 1]; ++pos) {
+                    /* no spike can be causal across this synapse */
+                    if (g_network.win_lo[pos] > g_network.win_hi[pos]) continue;
+                    SynapseGet(&g_network, tgt_id, pos, presyn);
+
+                    /* query the synapse's causal window before each post spike */
+                    GNAT_query_range(&query, spp_post, presyn);
+
+                    /* apply edge test to queried range of the presynaptic neuron's index */
+                    if (sp->engine == ENGINE_LQTREE) {
+                        LQTreeMapGNATEdge(g_lqtarray[presyn->src_id], &query, spp_post, presyn, sp->tau, sp->thresh, eb, qs);
+                    } else if (sp->engine == ENGINE_PAIRFREE) {
+                        PairFreeMapGNATEdge(&g_raster.sp_times[g_raster.sp_offsets[presyn->src_id]],
+                                            g_raster.sp_offsets[presyn->src_id + 1] - g_raster.sp_offsets[presyn->src_id],
+                                            &query, spp_post, presyn, sp->tau, sp->thresh, eb, qs);
+                    } else {
+                        presyn_qtree = g_qtarray[presyn->src_id];
+                        QTreeMapGNATEdge(presyn_qtree, &query, spp_post, presyn, sp->tau, sp->thresh, eb, qs);
+                    }
+                } 
+            }
+            sp_b = sp_b->next;
+        }
+        sp_a = sp_a->next;
+    }
+}
+
+/*
+ * Self-join counterpart of search_post_range: finds the first order causal
+ * links of the task's post spikes once per synapse and pairs them up.
+ */
+static void search_synapse_links(struct SearchTask *t, struct CausalLinks *links, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    struct Synapse syn, *presyn = &syn;
+    const long *post_ts, *pre_ts;
+    unsigned long n_post, n_pre, pos;
+
+    post_ts = &g_raster.sp_times[g_raster.sp_offsets[t->post_idx]];
+    n_post = g_raster.sp_offsets[t->post_idx + 1] - g_raster.sp_offsets[t->post_idx];
+
+    for (pos = g_network.offsets[t->post_idx]; pos < g_network.offsets[t->post_idx + 1]; ++pos) {
+        /* no spike can be causal across this synapse */
+        if (g_network.win_lo[pos] > g_network.win_hi[pos]) continue;
+        SynapseGet(&g_network, t->post_idx, pos, presyn);
+
+        pre_ts = &g_raster.sp_times[g_raster.sp_offsets[presyn->src_id]];
+        n_pre = g_raster.sp_offsets[presyn->src_id + 1] - g_raster.sp_offsets[presyn->src_id];
+
+        GNAT_find_causal_links(links, post_ts, n_post, t->i_first, pre_ts, n_pre, presyn);
+        if (links->n < 2) continue;
+
+        SelfJoinGNATEdges(links, t->post_idx, post_ts, t->i_first, t->n_a, pre_ts, presyn, eb, qs);
+    }
+}
+
+/*
+ * Worker thread: runs tasks from its own deque and steals from the
+ * other workers when it runs dry.
+ * The quadtrees are read-only during the search and are shared without locking.
+ */
+static void *search_worker(void *arg) {
+
+    struct SearchWorker *w = (struct SearchWorker *)arg;
+    struct SearchParams *sp = w->sp;
+    struct EdgeBuffer *eb;
+    struct CausalLinks *links;
+    struct SearchTask t;
+
+    TRACE_THREAD_NAME("search", w->id);
+    PerfThreadBegin("search", w->id);
+
+    eb = EdgeBufferCreate();
+    links = CausalLinksCreate();
+
+    while (SchedNext(&sp->sched, w->id, &t)) {
 
         /* print status */
-        if ((post_idx % 10) == 0) {
-            printf("Cell %d of %d\n", post_idx, g_network.n_cells);
+        if ((t.post_idx % 10) == 0 && t.i_first == 0) {
+            printf("Cell %lu of %lu\n", t.post_idx, g_network.n_cells);
+        }
+        TRACE_BEGIN_ARG("cell", "cell", t.post_idx);
+        if (sp->engine == ENGINE_SELFJOIN) {
+            search_synapse_links(&t, links, eb, &w->qs);
+        } else {
+            search_post_range(&t, sp, eb, &w->qs);
         }
+        TRACE_END("cell");
+        SchedTaskDone(&sp->sched);
+    }
 
-        /* iterate over spike pairs in post qtree */
-        sp_a = g_raster.sp_lists[post_idx];
-        while (sp_a) {
-            sp_b = sp_a->next;
-            while(sp_b) {
-                if (!spike_equals(sp_a, sp_b)) {
-                    spp_post = create_spike_pair(sp_a, sp_b);
-                    //print_spike_pair(spp_post);
-                    tgt_id = post_idx;
-                    /* list of presynaptic partners */
-                    presyn = g_network.presyns[tgt_id];
-
-                    while (presyn) {
-                        /* quadtree associated to presynaptic neuron */
-                        presyn_qtree = g_qtarray[presyn->src_id];
+    /* write out whatever is left in this thread's buffer */
+    EdgeBufferDestroy(eb);
+    CausalLinksDestroy(links);
 
-                        /* set query bounding box */
-                        query_bbox.c_x = spp_post->sp1->ts;
-                        query_bbox.c_y = spp_post->sp2->ts;
-                        query_bbox.w2  = c_radius;
+    PerfThreadEnd();
+    return NULL;
+}
 
-                        /* apply edge test to queried range */
-                        QTreeMapGNATEdge(presyn_qtree, &query_bbox, spp_post, presyn, tau, thresh);
-                        presyn = presyn->next;
+/*
+ * Seeds the scheduler with one task per postsynaptic cell, dealt round robin
+ * to the workers.  The grain size is chosen so that the work can be cut into
+ * about TASKS_PER_THREAD tasks per worker.
+ */
+static void seed_search_tasks(struct Scheduler *s, int n_threads) {
 
-                    } 
-                }
-                sp_b = sp_b->next;
+    struct SearchTask t;
+    struct Spike *sp;
+    unsigned long post_idx, n_tasks = 0;
+    double total_cost = 0;
+
+    for (post_idx = 0; post_idx < g_network.n_cells; ++post_idx) {
+
+        t.post_idx = post_idx;
+        t.sp_first = g_raster.sp_lists[post_idx];
+        t.i_first = 0;
+
+        t.n_spikes = 0;
+        for (sp = t.sp_first; sp; sp = sp->next) t.n_spikes++;
+        t.n_a = t.n_spikes;
+
+        t.n_presyn = g_network.offsets[post_idx + 1] - g_network.offsets[post_idx];
+
+        /* nothing to search */
+        if (t.n_spikes < 2 || t.n_presyn == 0) continue;
+
+        total_cost += SearchTaskCost(&t);
+        SchedPush(s, n_tasks % n_threads, &t);
+        n_tasks++;
+    }
+
+    s->grain = total_cost / ((double)n_threads * TASKS_PER_THREAD);
+    if (s->grain < 1) s->grain = 1;
+}
+
+/*
+ * Sums and prints the query counters of all workers
+ */
+static void print_query_stats(struct SearchWorker *workers, int n_threads) {
+
+    struct QueryStats tot;
+    int idx;
+
+    memset(&tot, 0, sizeof(struct QueryStats));
+    for (idx = 0; idx < n_threads; ++idx) {
+        tot.n_queries += workers[idx].qs.n_queries;
+        tot.nodes_visited += workers[idx].qs.nodes_visited;
+        tot.pairs_tested += workers[idx].qs.pairs_tested;
+        tot.pairs_bulk += workers[idx].qs.pairs_bulk;
+        tot.bbox_rejects += workers[idx].qs.bbox_rejects;
+        tot.edge_tests += workers[idx].qs.edge_tests;
+        tot.edge_hits += workers[idx].qs.edge_hits;
+    }
+
+    g_phases[PHASE_SEARCH].candidates = tot.pairs_tested + tot.pairs_bulk;
+    PhaseCounter("queries", tot.n_queries);
+    PhaseCounter("nodes_visited", tot.nodes_visited);
+    PhaseCounter("bbox_rejects", tot.bbox_rejects);
+    PhaseCounter("pairs_tested", tot.pairs_tested);
+    PhaseCounter("pairs_bulk", tot.pairs_bulk);
+    PhaseCounter("edge_tests", tot.edge_tests);
+    PhaseCounter("edge_hits", tot.edge_hits);
+
+    printf("Search: %lu queries, %lu nodes visited, %lu pairs tested, %lu pairs taken in bulk\n",
+           tot.n_queries, tot.nodes_visited, tot.pairs_tested, tot.pairs_bulk);
+    if (tot.n_queries) {
+        printf("Per query: %.2f nodes visited, %.2f pairs tested\n",
+               (double)tot.nodes_visited / tot.n_queries, (double)tot.pairs_tested / tot.n_queries);
+    }
+}
+
+void compute_gnat_edges(float tau, float thresh, int n_threads, enum GNATEngine engine) {
+
+    struct SearchParams sp;
+    struct SearchWorker *workers;
+    int idx;
+
+    sp.tau = tau;
+    sp.thresh = thresh;
+    sp.engine = engine;
+
+    SchedInit(&sp.sched, n_threads, 0);
+    seed_search_tasks(&sp.sched, n_threads);
+
+    workers = malloc(n_threads * sizeof(struct SearchWorker));
+    if (!workers) {
+        printf("FATAL: Unable to allocate search threads\n");
+        exit(-1);
+    }
+
+    for (idx = 0; idx < n_threads; ++idx) {
+        workers[idx].id = idx;
+        workers[idx].sp = &sp;
+        memset(&workers[idx].qs, 0, sizeof(struct QueryStats));
+    }
+
+    if (n_threads == 1) {
+        search_worker(&workers[0]);
+    } else {
+        for (idx = 0; idx < n_threads; ++idx) {
+            if (pthread_create(&workers[idx].thread, NULL, search_worker, &workers[idx])) {
+                printf("FATAL: Unable to start search thread %d\n", idx);
+                exit(-1);
             }
-            sp_a = sp_a->next;
         }
+
+        for (idx = 0; idx < n_threads; ++idx) {
+            pthread_join(workers[idx].thread, NULL);
+        }
+        SchedPrintStats(&sp.sched);
     }
+
+    print_query_stats(workers, n_threads);
+
+    free(workers);
+    SchedDestroy(&sp.sched);
 }
 
 
-void insert_spike_pairs (struct QuadTree *qt, struct Spike *list_head) {
+void insert_spike_pairs (struct Arena *arena, struct QuadTree *qt, struct Spike *list_head) {
 
     struct Spike *sp_a, *sp_b;
     struct SpikePair *spp;
@@ -111,8 +358,8 @@ void insert_spike_pairs (struct QuadTree *qt, struct Spike *list_head) {
         sp_b = sp_a->next;
         while(sp_b) {
             if (!spike_equals(sp_a, sp_b)) {
-                spp = create_spike_pair(sp_a, sp_b);
-                QTreeInsert(qt, spp);
+                spp = create_spike_pair(arena, sp_a, sp_b);
+                QTreeInsert(arena, qt, spp);
             }
             sp_b = sp_b->next;
         }
@@ -120,23 +367,348 @@ void insert_spike_pairs (struct QuadTree *qt, struct Spike *list_head) {
     }
 }
 
-int main(int argc, char **argv) {
+static double elapsed_s(struct timespec *t_start) {
+
+    struct timespec t_end;
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    return (t_end.tv_sec - t_start->tv_sec) + 1e-9 * (t_end.tv_nsec - t_start->tv_nsec);
+}
+
+/*
+ * Peak resident set size of the process so far, in kB.  The kernel's
+ * watermark is reset at every phase boundary, so this is taken from
+ * memstat rather than getrusage.
+ */
+static long peak_rss_kb(void) {
+
+    return MemPeakRSS();
+}
+
+/* pairs of spikes of cell idx, the pairs its index holds */
+static unsigned long cell_spike_pairs(unsigned long idx) {
+
+    unsigned long k;
+    struct Spike *sp;
+
+    if (g_raster.sp_offsets) {
+        k = g_raster.sp_offsets[idx + 1] - g_raster.sp_offsets[idx];
+    } else {
+        for (k = 0, sp = g_raster.sp_lists[idx]; sp; sp = sp->next) k++;
+    }
+    return k * (k - (k > 0)) / 2;
+}
+
+/*
+ * Estimates from the spike count of each cell the bytes the index and the
+ * edge buffers will take, and stops the run before it starts if they do
+ * not fit: with mem_limit_mb > 0 in that many MB less the current RSS,
+ * otherwise in what MemHeadroom reports.  mem_limit_mb == 0 skips the
+ * check.  Returns the estimate.
+ */
+static unsigned long check_memory(unsigned long _n_cells, enum GNATEngine engine, int use_arena,
+                                  unsigned long buf_size, unsigned long n_bufs, long mem_limit_mb) {
+
+    unsigned long idx, pairs, n_pairs = 0, max_pairs = 0, qtree_bytes = 0, index_bytes, buf_bytes;
+    long long headroom;
+
+    for (idx = 0; idx < _n_cells; ++idx) {
+        pairs = cell_spike_pairs(idx);
+        n_pairs += pairs;
+        if (pairs > max_pairs) max_pairs = pairs;
+        if (engine == ENGINE_QTREE) {
+            qtree_bytes += QTreeEstimateMemory(pairs, use_arena);
+        }
+    }
+
+    if (engine == ENGINE_PAIRFREE || engine == ENGINE_SELFJOIN) {
+        index_bytes = g_raster.sp_offsets ? 0 : (_n_cells + 1) * sizeof(unsigned long) + g_raster.n_spikes * sizeof(long);
+    } else if (engine == ENGINE_LQTREE) {
+        index_bytes = LQTreeEstimateMemory(_n_cells, n_pairs, max_pairs);
+    } else {
+        index_bytes = qtree_bytes;
+    }
+    buf_bytes = n_bufs * buf_size * sizeof(struct GNATEdge);
+
+    printf("Memory estimate: %lu spike pairs, index %.1f MB, edge buffers %.1f MB\n", n_pairs,
+           index_bytes / 1048576.0, buf_bytes / 1048576.0);
+
+    if (mem_limit_mb == 0) return index_bytes + buf_bytes;
+    if (mem_limit_mb > 0) {
+        headroom = 1048576LL * mem_limit_mb - 1024LL * MemCurrentRSS();
+    } else {
+        headroom = MemHeadroom();
+        if (headroom < 0) return index_bytes + buf_bytes;
+    }
+
+    if ((long long)(index_bytes + buf_bytes) > headroom) {
+        printf("FATAL: Run needs about %.1f MB more but only %.1f MB are available (-M sets the limit, -M 0 skips this check)\n",
+               (index_bytes + buf_bytes) / 1048576.0, headroom / 1048576.0);
+        MemReport();
+        exit(-1);
+    }
+    return index_bytes + buf_bytes;
+}
+
+/*
+ * Builds the spike pair index of every cell for the chosen engine.
+ * With use_arena the quadtree engine takes its objects from one arena per cell,
+ * sized from the cell's spike pair count.
+ */
+void build_neuron_indices(unsigned long _n_cells, enum GNATEngine engine, int use_arena) {
 
     float _cx, _cy, _hw;
+    struct BoundingBox *bbox_top_level;
+    unsigned int log2_size;
+    unsigned long idx, mem = 0;
+    struct timespec t_start;
+
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    if (engine == ENGINE_PAIRFREE || engine == ENGINE_SELFJOIN) {
+        /* no pair index, only the flat spike time arrays */
+        RasterBuildArrays(&g_raster);
+        mem = (_n_cells + 1) * sizeof(unsigned long) + g_raster.n_spikes * sizeof(long);
+    } else if (engine == ENGINE_LQTREE) {
+        g_lqtarray = malloc(_n_cells * sizeof(struct LQTree *));
+        if (!g_lqtarray) {
+            printf("FATAL: Unable to allocate space for neuron linear quadtrees\n");
+            exit(-1);
+        }
+
+        log2_size = LQTreeRootLog2Size(g_raster.t_min, g_raster.t_max);
+        for (idx = 0; idx < _n_cells; ++idx) {
+            g_lqtarray[idx] = LQTreeBuild(idx, g_raster.sp_lists[idx], g_raster.t_min, log2_size);
+            mem += LQTreeMemory(g_lqtarray[idx]);
+            g_phases[PHASE_INDEX].pairs_indexed += g_lqtarray[idx]->n_pairs;
+#ifdef SPDEBUG
+            printf("-------- LQTree --------\n");
+            LQTreePrint(g_lqtarray[idx]);
+            printf("-------- End LQTree --------\n");
+#endif
+        }
+    } else {
+        /* Attempt to allocate space for each quadtree */
+        g_qtarray = malloc(_n_cells * sizeof(struct QuadTree *));
+        if (!g_qtarray) {
+            printf("FATAL: Unable to allocate space for neuron quadtrees\n");
+            exit(-1);
+        }
+
+        g_qtarenas = calloc(_n_cells, sizeof(struct Arena *));
+        if (!g_qtarenas) {
+            printf("FATAL: Unable to allocate space for neuron arenas\n");
+            exit(-1);
+        }
+
+        /* build top-level bouding box, padded so that t_max lies inside */
+        _cx = (float)(g_raster.t_max + g_raster.t_min)/2;
+        _cy = _cx;
+        _hw = (float)(g_raster.t_max - g_raster.t_min)/2 + 1;
+        bbox_top_level = BBoxCreate(NULL, _cx, _cy, _hw);
+
+        /* build quadtrees for each cell */
+        for (idx = 0; idx < _n_cells; ++idx) {
+            if (use_arena) {
+                g_qtarenas[idx] = QTreeArenaCreate(cell_spike_pairs(idx));
+            }
+            g_qtarray[idx] = QTreeCreate(g_qtarenas[idx], bbox_top_level);
+            insert_spike_pairs(g_qtarenas[idx], g_qtarray[idx], g_raster.sp_lists[idx]);
+            mem += QTreeMemory(g_qtarray[idx]);
+#ifdef SPDEBUG
+            printf("-------- QuadTree --------\n");
+            QTreePrint(g_qtarray[idx]);
+            printf("-------- End QuadTree --------\n");
+#endif
+        }
+    }
+
+    if (engine == ENGINE_QTREE) {
+        g_phases[PHASE_INDEX].pairs_indexed = qt_counters.pairs_inserted;
+        PhaseCounter("subdivisions", qt_counters.subdivisions);
+        PhaseCounter("pairs_moved", qt_counters.pairs_moved);
+    }
+
+    printf("Index build: %.3f s, %lu bytes, peak RSS %ld kB\n", elapsed_s(&t_start), mem, peak_rss_kb());
+}
+
+/*
+ * Releases the quadtree arenas, one call per cell
+ */
+void free_neuron_arenas(unsigned long _n_cells) {
+
+    unsigned long idx;
+
+    if (!g_qtarenas) return;
+
+    for (idx = 0; idx < _n_cells; ++idx) {
+        ArenaFree(g_qtarenas[idx]);
+    }
+}
+
+static void usage(const char *progname) {
+
+    printf("Usage: %s [-t n_threads] [-e qtree|lqtree|pairfree|selfjoin] [-k auto|scalar|avx2|avx512] [-A malloc|arena] [-f text|bin|bin-gamma|wcc|wcc-forest] [-b buffer_edges] [-B n_buffers] [-c] [-j stats.json] [-T trace.json] [-P] [-M mem_limit_MB] <N cells> <spike file> <network file> <tau> <thresh> [causal_radius]\n", progname);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+
     float tau, thresh, c_radius;
     unsigned long _n_cells;
-    struct BoundingBox *bbox_top_level;
+    int opt, n_threads = 1, use_arena = 0, use_cache = 0, use_perf = 0;
+    long mem_limit_mb = -1;
+    struct timespec t_start;
+    enum GNATEngine engine = ENGINE_QTREE;
+    enum GNATBatchKernel kernel = BATCH_AUTO;
+    enum EdgeFormat out_fmt = EDGE_TEXT;
+    unsigned long buf_size = N_EDGBUF, n_bufs = 0;
+    char *out_fname = "gnat2_out.txt";
+    const char *raster_src = "text", *network_src = "text";
+    const char *stats_fname = NULL, *trace_fname = NULL;
+    const char *engine_name = "qtree", *fmt_name = "text", *threads_str = "1";
+    char n_spikes_str[32], n_syns_str[32], mem_estimate_str[32];
+    unsigned long mem_estimate;
+
+    /* parse options */
+    while ((opt = getopt(argc, argv, "t:e:k:A:f:b:B:cj:T:PM:")) != -1) {
+        switch (opt) {
+            case 't':
+                n_threads = strtol(optarg, NULL, 0);
+                threads_str = optarg;
+                break;
+            case 'e':
+                if (!strcmp(optarg, "qtree")) {
+                    engine = ENGINE_QTREE;
+                } else if (!strcmp(optarg, "lqtree")) {
+                    engine = ENGINE_LQTREE;
+                } else if (!strcmp(optarg, "pairfree")) {
+                    engine = ENGINE_PAIRFREE;
+                } else if (!strcmp(optarg, "selfjoin")) {
+                    engine = ENGINE_SELFJOIN;
+                } else {
+                    printf("FATAL: Unknown engine %s\n", optarg);
+                    exit(-1);
+                }
+                engine_name = optarg;
+                break;
+            case 'k':
+                if (!strcmp(optarg, "auto")) {
+                    kernel = BATCH_AUTO;
+                } else if (!strcmp(optarg, "scalar")) {
+                    kernel = BATCH_SCALAR;
+                } else if (!strcmp(optarg, "avx2")) {
+                    kernel = BATCH_AVX2;
+                } else if (!strcmp(optarg, "avx512")) {
+                    kernel = BATCH_AVX512;
+                } else {
+                    printf("FATAL: Unknown batch kernel %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'A':
+                if (!strcmp(optarg, "malloc")) {
+                    use_arena = 0;
+                } else if (!strcmp(optarg, "arena")) {
+                    use_arena = 1;
+                } else {
+                    printf("FATAL: Unknown allocator %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'f':
+                if (!strcmp(optarg, "text")) {
+                    out_fmt = EDGE_TEXT;
+                } else if (!strcmp(optarg, "bin")) {
+                    out_fmt = EDGE_BINARY;
+                } else if (!strcmp(optarg, "bin-gamma")) {
+                    out_fmt = EDGE_BINARY_GAMMA;
+                } else if (!strcmp(optarg, "wcc")) {
+                    out_fmt = EDGE_WCC;
+                } else if (!strcmp(optarg, "wcc-forest")) {
+                    out_fmt = EDGE_WCC_FOREST;
+                } else {
+                    printf("FATAL: Unknown output format %s\n", optarg);
+                    exit(-1);
+                }
+                fmt_name = optarg;
+                break;
+            case 'b':
+                buf_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'B':
+                n_bufs = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                use_cache = 1;
+                break;
+            case 'j':
+                stats_fname = optarg;
+                break;
+            case 'T':
+                trace_fname = optarg;
+                break;
+            case 'P':
+                use_perf = 1;
+                break;
+            case 'M':
+                mem_limit_mb = atol(optarg);
+                if (mem_limit_mb < 0) {
+                    printf("FATAL: Memory limit must be at least 0 MB\n");
+                    exit(-1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
 
     /* check num args */
-    if (argc < 7) {
-        printf("Usage: %s <N cells> <spike file> <network file> <tau> <thresh> <causal_radius>\n", argv[0]);
-        exit(-1);
+    if (argc - optind < 5) {
+        usage(argv[0]);
     }
 
+    /* shift positional arguments so that argv[1] is the cell count */
+    argv += optind - 1;
+
     _n_cells = strtol(argv[1], NULL, 0);
     tau = strtof(argv[4], NULL);
     thresh = strtof(argv[5], NULL);
-    c_radius = strtof(argv[6], NULL);
+    /* without a causal radius only the per-synapse causal windows limit the search */
+    c_radius = (argc - optind > 5) ? strtof(argv[6], NULL) : 0;
+
+    if (n_threads < 1) {
+        printf("FATAL: Need at least one search thread\n");
+        exit(-1);
+    }
+
+    /* by default every search thread can fill one buffer while another is written */
+    if (n_bufs == 0) {
+        n_bufs = 2 * n_threads;
+    }
+    if (n_bufs < (unsigned long) n_threads) {
+        printf("FATAL: Need at least one edge buffer per search thread\n");
+        exit(-1);
+    }
+
+    if (trace_fname) {
+#ifdef GNAT_TRACE
+        TraceEnable();
+#else
+        printf("FATAL: Tracing needs a build with -DGNAT_TRACE\n");
+        exit(-1);
+#endif
+    }
+
+    /* before any thread is started, so the counters cover them all */
+    if (use_perf) {
+        PerfEnable();
+    }
+
+    if (GNAT_batch_init(kernel)) {
+        printf("FATAL: Batch kernel not supported by this CPU\n");
+        exit(-1);
+    }
 
     if (RasterInit(&g_raster, _n_cells)) {
         printf("Problem initializing raster\n");
@@ -146,46 +718,131 @@ int main(int argc, char **argv) {
         printf("Problem initializing network\n");
     }
 
-    /* Attempt to allocate space for each quadtree */
-    g_qtarray = malloc(_n_cells * sizeof(struct QuadTree *));
-    if (!g_qtarray) {
-        printf("FATAL: Unable to allocate space for neuron quadtrees\n");
-        exit(-1);
-    }
-
     /* Read spikes from file into global raster */
-    RasterReadFile(&g_raster, argv[2]);
+    PhaseBegin(PHASE_PARSE);
+    TRACE_BEGIN("parse");
+    PhaseBegin(PHASE_RASTER);
+    TRACE_BEGIN("raster_read");
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    if (use_arena) {
+        g_raster.arena = ArenaCreate(0);
+    }
+    if (use_cache && !RasterMapCache(&g_raster, argv[2])) {
+        raster_src = "cache";
+    } else {
+        RasterReadFile(&g_raster, argv[2], n_threads);
+        if (use_cache && RasterWriteCache(&g_raster, argv[2])) {
+            printf("WARNING: Unable to write raster cache\n");
+        }
+    }
+    TRACE_END("raster_read");
+    PhaseEnd(PHASE_RASTER);
+    printf("Raster read (%s): %.3f s, %lu spikes, peak RSS %ld kB\n", raster_src, elapsed_s(&t_start), g_raster.n_spikes, peak_rss_kb());
 
     /* Attempt to read network connectivity file */
-    PhysNetworkReadFile(&g_network, argv[3]);
+    PhaseBegin(PHASE_NETWORK);
+    TRACE_BEGIN("network_read");
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    if (use_cache && !PhysNetworkMapCache(&g_network, argv[3])) {
+        network_src = "cache";
+    } else {
+        PhysNetworkReadFile(&g_network, argv[3], n_threads, use_cache);
+        if (use_cache && PhysNetworkWriteCache(&g_network, argv[3])) {
+            printf("WARNING: Unable to write network cache\n");
+        }
+    }
+    TRACE_END("network_read");
+    PhaseEnd(PHASE_NETWORK);
+    printf("Network read (%s): %.3f s, peak RSS %ld kB\n", network_src, elapsed_s(&t_start), peak_rss_kb());
     //PhysNetworkPrint(&g_network);
+    GNAT_compute_windows(&g_network, tau, thresh, c_radius);
+    TRACE_END("parse");
+    PhaseEnd(PHASE_PARSE);
+
+    /* the linear quadtree holds times as 32 bit offsets */
+    if (engine == ENGINE_LQTREE && g_raster.n_spikes && !LQTreeSpanFits(g_raster.t_min, g_raster.t_max)) {
+        printf("WARNING: Recording spans %lu ticks, more than lqtree can hold, using qtree\n",
+               (unsigned long)(g_raster.t_max - g_raster.t_min) + 1);
+        engine = ENGINE_QTREE;
+        engine_name = "qtree";
+    }
+    if (engine == ENGINE_LQTREE) {
+        printf("Batch kernel: %s\n", GNAT_batch_name());
+    }
 
-    /* build top-level bouding box */
-    _cx = (float)(g_raster.t_max + g_raster.t_min)/2;
-    _cy = _cx;
-    _hw = (float)(g_raster.t_max - g_raster.t_min)/2;
-    bbox_top_level = BBoxCreate(_cx, _cy, _hw);
+    /* refuse a run that will not fit before building anything */
+    mem_estimate = check_memory(_n_cells, engine, use_arena, buf_size, n_bufs, mem_limit_mb);
 
-    /* build quadtrees for each cell */
-    unsigned int idx;
-    for (idx = 0; idx < _n_cells; ++idx) {
-        g_qtarray[idx] = QTreeCreate(bbox_top_level);
-        insert_spike_pairs(g_qtarray[idx], g_raster.sp_lists[idx]);
-#ifdef SPDEBUG
-        printf("-------- QuadTree --------\n");
-        QTreePrint(g_qtarray[idx]);
-        printf("-------- End QuadTree --------\n");
-#endif
-    }
+    /* build the spike pair index of each cell */
+    PhaseBegin(PHASE_INDEX);
+    TRACE_BEGIN("index");
+    build_neuron_indices(_n_cells, engine, use_arena);
+    TRACE_END("index");
+    PhaseEnd(PHASE_INDEX);
 
     /* initialize output file */
-    initialize_edge_buffer("gnat2_out.txt");
+    if (out_fmt == EDGE_BINARY || out_fmt == EDGE_BINARY_GAMMA) {
+        out_fname = "gnat2_out.bin";
+    } else if (out_fmt == EDGE_WCC || out_fmt == EDGE_WCC_FOREST) {
+        out_fname = "gnat2_wcc.txt";
+    }
+    initialize_edge_buffer(out_fname, out_fmt, tau, &g_network, buf_size, n_bufs);
 
     /* compute gnats here */
-    compute_gnat_edges(tau, thresh, c_radius);
+    PhaseBegin(PHASE_SEARCH);
+    TRACE_BEGIN("search");
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    compute_gnat_edges(tau, thresh, n_threads, engine);
+    printf("Search time: %.3f s, peak RSS %ld kB\n", elapsed_s(&t_start), peak_rss_kb());
+    TRACE_END("search");
+    PhaseEnd(PHASE_SEARCH);
+
+    /* drain the writer */
+    PhaseBegin(PHASE_OUTPUT);
+    TRACE_BEGIN("output");
+    finalize_edge_buffer();
+    TRACE_END("output");
+    PhaseEnd(PHASE_OUTPUT);
+
+    /* edges are written as they are found, so both phases report them all */
+    g_phases[PHASE_SEARCH].edges = edges_written();
+    g_phases[PHASE_OUTPUT].edges = edges_written();
+    PhaseStatsPrint();
+    MemReport();
+
+    if (stats_fname) {
+        snprintf(n_spikes_str, sizeof(n_spikes_str), "%lu", g_raster.n_spikes);
+        snprintf(n_syns_str, sizeof(n_syns_str), "%lu", g_network.n_syns);
+        snprintf(mem_estimate_str, sizeof(mem_estimate_str), "%lu", mem_estimate);
+        PhaseInfo("engine", engine_name);
+        PhaseInfo("kernel", (engine == ENGINE_LQTREE) ? GNAT_batch_name() : "none");
+        PhaseInfo("format", fmt_name);
+        PhaseInfo("threads", threads_str);
+        PhaseInfo("allocator", use_arena ? "arena" : "malloc");
+        PhaseInfo("raster_input", raster_src);
+        PhaseInfo("network_input", network_src);
+        PhaseInfo("n_cells", argv[1]);
+        PhaseInfo("spike_file", argv[2]);
+        PhaseInfo("network_file", argv[3]);
+        PhaseInfo("tau", argv[4]);
+        PhaseInfo("thresh", argv[5]);
+        PhaseInfo("causal_radius", (argc - optind > 5) ? argv[6] : "0");
+        PhaseInfo("n_spikes", n_spikes_str);
+        PhaseInfo("n_synapses", n_syns_str);
+        PhaseInfo("memory_estimate", mem_estimate_str);
+        PhaseStatsWrite(stats_fname, "gnatfinder");
+    }
+
+#ifdef GNAT_TRACE
+    if (trace_fname) {
+        TraceWrite(trace_fname);
+    }
+#endif
 
     /* clean up */
-    finalize_edge_buffer();
+    free_neuron_arenas(_n_cells);
+    ArenaFree(g_raster.arena);
+    PhysNetworkFree(&g_network);
 
     return 0;
 }
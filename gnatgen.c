@@ -0,0 +1,348 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * gnatgen: writes a synthetic activity file and network file of
+ * controlled size for benchmarking, with causal sequences planted at
+ * known times.
+ *
+ * Background activity is a Poisson process per cell.  Each background
+ * spike may start a burst of further spikes at a fixed interval.  Every
+ * cell receives synapses from k random other cells, with uniform weights
+ * and integer delays.
+ *
+ * A planted pattern is a chain of distinct cells c_0 -> c_1 -> ... joined
+ * by synapses of weight 1.  Each repeat fires c_0 at a random time and
+ * every following cell one synapse delay plus a random jitter after its
+ * predecessor, so any two repeats form a second order edge across every
+ * link of the chain.  The planted spikes are listed in the pattern file
+ * as <pattern> <repeat> <neuron id> <time>.
+ *
+ * All random numbers come from a seeded splitmix64 generator, so the
+ * same options always give the same files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+
+struct GenSpike {
+
+    int64_t ts;
+    uint32_t n_id;
+};
+
+struct GenParams {
+
+    unsigned long n_cells;
+    int64_t duration;    /* ticks */
+    double rate;         /* spikes per cell per 1000 ticks */
+    unsigned long k;     /* synapses onto each cell */
+    double w_min;        /* weights are uniform in [w_min, 1) */
+    long max_delay;      /* delays are uniform in 1 .. max_delay */
+    double burst_p;      /* chance that a background spike starts a burst */
+    long burst_len;      /* extra spikes per burst */
+    long burst_isi;      /* ticks between burst spikes */
+    unsigned long n_patterns;
+    unsigned long pat_len;   /* cells per pattern */
+    unsigned long pat_reps;  /* repeats per pattern */
+    long jitter;             /* extra lag per link, uniform in 0 .. jitter */
+};
+
+/* planted synapse of a pattern link */
+struct GenLink {
+
+    uint32_t src_id;
+    uint32_t tgt_id;
+    long delay;
+};
+
+static uint64_t g_rng;
+
+static uint64_t rng_next(void) {
+
+    uint64_t z = (g_rng += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* uniform in [0, 1) */
+static double rng_uniform(void) {
+
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* uniform in 0 .. n - 1 */
+static uint64_t rng_below(uint64_t n) {
+
+    return rng_next() % n;
+}
+
+static struct GenSpike *g_spikes;
+static unsigned long g_n_spikes, g_cap_spikes;
+
+static void add_spike(int64_t ts, uint32_t n_id) {
+
+    if (g_n_spikes == g_cap_spikes) {
+        g_cap_spikes = g_cap_spikes ? 2 * g_cap_spikes : 65536;
+        g_spikes = realloc(g_spikes, g_cap_spikes * sizeof(struct GenSpike));
+        if (!g_spikes) {
+            printf("FATAL: Unable to allocate %lu spikes\n", g_cap_spikes);
+            exit(-1);
+        }
+    }
+    g_spikes[g_n_spikes].ts = ts;
+    g_spikes[g_n_spikes].n_id = n_id;
+    g_n_spikes++;
+}
+
+static int spike_cmp(const void *a, const void *b) {
+
+    const struct GenSpike *x = a, *y = b;
+
+    if (x->ts != y->ts) return (x->ts < y->ts) ? -1 : 1;
+    if (x->n_id != y->n_id) return (x->n_id < y->n_id) ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Poisson background activity of every cell, with bursts.
+ */
+static void gen_background(struct GenParams *gp) {
+
+    unsigned long cell;
+    double t, lambda = gp->rate / 1000.0;
+    long b;
+
+    if (lambda <= 0) return;
+
+    for (cell = 0; cell < gp->n_cells; ++cell) {
+        t = 0;
+        while (1) {
+            t += -log(1.0 - rng_uniform()) / lambda;
+            if (t >= gp->duration) break;
+            add_spike((int64_t)t, cell);
+            if (gp->burst_p > 0 && rng_uniform() < gp->burst_p) {
+                for (b = 1; b <= gp->burst_len; ++b) {
+                    if ((int64_t)t + b * gp->burst_isi >= gp->duration) break;
+                    add_spike((int64_t)t + b * gp->burst_isi, cell);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Chooses the cells and links of every pattern and plants its repeats,
+ * listing the planted spikes in fp_pat.
+ */
+static struct GenLink *gen_patterns(struct GenParams *gp, FILE *fp_pat) {
+
+    struct GenLink *links;
+    uint32_t *cells;
+    unsigned long pat, rep, i, j, n_links;
+    int64_t t, span;
+
+    n_links = gp->n_patterns * (gp->pat_len - 1);
+    links = malloc((n_links + 1) * sizeof(struct GenLink));
+    cells = malloc(gp->pat_len * sizeof(uint32_t));
+    if (!links || !cells) {
+        printf("FATAL: Unable to allocate patterns\n");
+        exit(-1);
+    }
+
+    for (pat = 0; pat < gp->n_patterns; ++pat) {
+
+        /* distinct cells, so that no link is a self connection */
+        for (i = 0; i < gp->pat_len; ++i) {
+            do {
+                cells[i] = rng_below(gp->n_cells);
+                for (j = 0; j < i && cells[j] != cells[i]; ++j);
+            } while (j < i);
+        }
+
+        span = 0;
+        for (i = 0; i + 1 < gp->pat_len; ++i) {
+            links[pat * (gp->pat_len - 1) + i].src_id = cells[i];
+            links[pat * (gp->pat_len - 1) + i].tgt_id = cells[i + 1];
+            links[pat * (gp->pat_len - 1) + i].delay = 1 + rng_below(gp->max_delay);
+            span += links[pat * (gp->pat_len - 1) + i].delay + gp->jitter;
+        }
+        if (span >= gp->duration) {
+            printf("FATAL: Pattern does not fit in the duration\n");
+            exit(-1);
+        }
+
+        for (rep = 0; rep < gp->pat_reps; ++rep) {
+            t = rng_below(gp->duration - span);
+            for (i = 0; i < gp->pat_len; ++i) {
+                if (i > 0) {
+                    t += links[pat * (gp->pat_len - 1) + i - 1].delay + rng_below(gp->jitter + 1);
+                }
+                add_spike(t, cells[i]);
+                fprintf(fp_pat, "%lu %lu %u %ld\n", pat, rep, cells[i], (long)t);
+            }
+        }
+    }
+    free(cells);
+    return links;
+}
+
+/*
+ * Writes k random synapses onto every cell, after the planted links onto it.
+ * A source is used at most once per target.
+ */
+static void write_network(struct GenParams *gp, struct GenLink *links, FILE *fp) {
+
+    unsigned long *stamp, tgt, src, n, idx, n_links, k;
+
+    n_links = gp->n_patterns * (gp->pat_len - 1);
+    k = (gp->k < gp->n_cells) ? gp->k : gp->n_cells - 1;
+
+    stamp = calloc(gp->n_cells, sizeof(unsigned long));
+    if (!stamp) {
+        printf("FATAL: Unable to allocate network\n");
+        exit(-1);
+    }
+
+    for (tgt = 0; tgt < gp->n_cells; ++tgt) {
+        /* stamp[src] == tgt + 1 marks a source already used onto tgt */
+        stamp[tgt] = tgt + 1;
+        for (idx = 0; idx < n_links; ++idx) {
+            if (links[idx].tgt_id != tgt || stamp[links[idx].src_id] == tgt + 1) continue;
+            stamp[links[idx].src_id] = tgt + 1;
+            fprintf(fp, "%u %lu 1.000000 %ld\n", links[idx].src_id, tgt, links[idx].delay);
+        }
+        for (n = 0; n < k; ++n) {
+            src = rng_below(gp->n_cells);
+            if (stamp[src] == tgt + 1) {
+                /* dense networks: take the next unused source instead */
+                for (idx = 0; idx < gp->n_cells && stamp[src] == tgt + 1; ++idx) {
+                    src = (src + 1) % gp->n_cells;
+                }
+                if (stamp[src] == tgt + 1) break;
+            }
+            stamp[src] = tgt + 1;
+            fprintf(fp, "%lu %lu %f %ld\n", src, tgt,
+                    gp->w_min + (1.0 - gp->w_min) * rng_uniform(), 1 + (long)rng_below(gp->max_delay));
+        }
+    }
+    free(stamp);
+}
+
+static void usage(const char *progname) {
+
+    printf("Usage: %s [-s seed] [-n n_cells] [-T duration] [-r rate] [-k synapses_per_cell] [-w min_weight] [-d max_delay] "
+           "[-b burst_prob] [-l burst_len] [-i burst_isi] [-p n_patterns] [-L pattern_len] [-R repeats] [-j jitter] "
+           "<activity file> <network file> [pattern file]\n", progname);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+
+    struct GenParams gp = {1000, 10000, 20.0, 10, 0.1, 5, 0.0, 3, 2, 0, 5, 10, 1};
+    struct GenLink *links;
+    FILE *fp, *fp_pat;
+    unsigned long idx, n_out;
+    int opt;
+
+    g_rng = 1;
+
+    /* parse options */
+    while ((opt = getopt(argc, argv, "s:n:T:r:k:w:d:b:l:i:p:L:R:j:")) != -1) {
+        switch (opt) {
+            case 's': g_rng = strtoull(optarg, NULL, 0); break;
+            case 'n': gp.n_cells = strtoul(optarg, NULL, 0); break;
+            case 'T': gp.duration = strtoll(optarg, NULL, 0); break;
+            case 'r': gp.rate = strtod(optarg, NULL); break;
+            case 'k': gp.k = strtoul(optarg, NULL, 0); break;
+            case 'w': gp.w_min = strtod(optarg, NULL); break;
+            case 'd': gp.max_delay = strtol(optarg, NULL, 0); break;
+            case 'b': gp.burst_p = strtod(optarg, NULL); break;
+            case 'l': gp.burst_len = strtol(optarg, NULL, 0); break;
+            case 'i': gp.burst_isi = strtol(optarg, NULL, 0); break;
+            case 'p': gp.n_patterns = strtoul(optarg, NULL, 0); break;
+            case 'L': gp.pat_len = strtoul(optarg, NULL, 0); break;
+            case 'R': gp.pat_reps = strtoul(optarg, NULL, 0); break;
+            case 'j': gp.jitter = strtol(optarg, NULL, 0); break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+    }
+    if (gp.n_cells < 2 || gp.n_cells > UINT32_MAX || gp.duration < 1 || gp.max_delay < 1 ||
+        gp.w_min <= 0 || gp.w_min > 1 || gp.burst_isi < 1 || gp.jitter < 0) {
+        printf("FATAL: Invalid generator parameters\n");
+        exit(-1);
+    }
+    if (gp.n_patterns > 0 && (gp.pat_len < 2 || gp.pat_len > gp.n_cells)) {
+        printf("FATAL: Patterns need 2 .. n_cells cells\n");
+        exit(-1);
+    }
+
+    fp_pat = fopen((argc - optind > 2) ? argv[optind + 2] : "/dev/null", "w");
+    if (!fp_pat) {
+        printf("FATAL: Unable to open pattern file\n");
+        exit(-1);
+    }
+
+    gen_background(&gp);
+    links = gen_patterns(&gp, fp_pat);
+    fclose(fp_pat);
+
+    /* activity file: sorted in time, without repeated spikes of a cell */
+    qsort(g_spikes, g_n_spikes, sizeof(struct GenSpike), spike_cmp);
+    fp = fopen(argv[optind], "w");
+    if (!fp) {
+        printf("FATAL: Unable to open activity file %s\n", argv[optind]);
+        exit(-1);
+    }
+    n_out = 0;
+    for (idx = 0; idx < g_n_spikes; ++idx) {
+        if (idx > 0 && !spike_cmp(&g_spikes[idx - 1], &g_spikes[idx])) continue;
+        fprintf(fp, "0 %lx %u\n", (unsigned long)g_spikes[idx].ts, g_spikes[idx].n_id);
+        n_out++;
+    }
+    fclose(fp);
+
+    fp = fopen(argv[optind + 1], "w");
+    if (!fp) {
+        printf("FATAL: Unable to open network file %s\n", argv[optind + 1]);
+        exit(-1);
+    }
+    write_network(&gp, links, fp);
+    fclose(fp);
+
+    printf("Wrote %lu spikes of %lu cells over %ld ticks, %lu patterns\n", n_out, gp.n_cells, (long)gp.duration, gp.n_patterns);
+
+    free(links);
+    free(g_spikes);
+    return 0;
+}
@@ -28,10 +28,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "quadtree.h"
+#include "lqtree.h"
 #include "network.h"
 #include "gnats.h"
+#include "gnatbatch.h"
+#include "edgefile.h"
+#include "wcc.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "memstat.h"
 
 
 #define LARGE_GAMMA 999999
@@ -43,91 +52,431 @@
 
 
 /* 
- * GNAT Edge buffer
- * Buffers activity graph edges before writing to disk
+ * GNAT Edge buffers
+ * Each search thread buffers activity graph edges in one array of a shared
+ * pool.  A full array is queued for the writer thread and swapped for a
+ * free one, so the search only waits on output when the pool runs dry.
  */
 
-static struct GNATEdge g_edgbuf[N_EDGBUF];
-static unsigned long edgbuf_sz = 0; /* number of edges currently in buffer */
+struct EdgeWriter {
 
-static FILE *fp_edgbuf;
+    FILE *fp;
+    enum EdgeFormat fmt;
+    float tau;          /* for the gamma values of EDGE_BINARY_GAMMA */
+    const struct PhysNetwork *pn;
+    uint64_t n_written; /* edges written so far */
 
-void fprint_GNAT_edge(FILE *fp, struct GNATEdge *edg) {
+    /* EDGE_WCC and EDGE_WCC_FOREST: edges go to a union-find instead of fp */
+    struct WCC *wcc;
+    FILE *fp_forest;
+
+    unsigned long buf_size; /* edges per array */
+    unsigned long n_bufs;   /* arrays in the pool */
+    struct GNATEdge **arrays;
+
+    /* free arrays, a stack */
+    struct GNATEdge **free_bufs;
+    unsigned long n_free;
+
+    /* full arrays waiting to be written, a ring of n_bufs slots */
+    struct GNATEdge **full_bufs;
+    unsigned long *full_sz;
+    unsigned long full_head, n_full;
+
+    int done;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cv_free; /* an array was returned to the pool */
+    pthread_cond_t cv_full; /* an array was queued, or done was set */
+
+    /* stats */
+    unsigned long n_swaps;  /* arrays handed to the writer */
+    unsigned long n_blocks; /* swaps that had to wait for a free array */
+    double t_blocked;       /* seconds searchers spent waiting, summed */
+    double t_write;         /* seconds the writer spent writing */
+};
+
+static struct EdgeWriter g_writer;
+
+#define EDGE_RECORD_CHUNK 256 /* binary records converted per write */
 
+static double now_s(void) {
 
-    unsigned long n_id_1, n_id_2;
-    long t_11, t_12, t_21, t_22;
+    struct timespec ts;
 
-    n_id_1 = edg->spp_pre->sp1->n_id;
-    n_id_2 = edg->spp_post->sp1->n_id;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
 
-    t_11 = edg->spp_pre->sp1->ts;
-    t_12 = edg->spp_pre->sp2->ts;
+void fprint_GNAT_edge(FILE *fp, struct GNATEdge *edg) {
 
-    t_21 = edg->spp_post->sp1->ts;
-    t_22 = edg->spp_post->sp2->ts;
 
     /* format is <pre neuron id> <spike time 1> <spike time 2> <post neuron id> <spike time 1> <spike time 2>*/
-    fprintf(fp, "%ld %ld %ld %ld %ld %ld\n", n_id_1, t_11, t_12, n_id_2, t_21, t_22);
+    fprintf(fp, "%u %ld %ld %u %ld %ld\n", edg->pre_id, edg->t_pre1, edg->t_pre2, edg->post_id, edg->t_post1, edg->t_post2);
+}
+
+/*
+ * Converts edges[0..n) to binary records and writes them
+ */
+static void write_edge_records(struct GNATEdge *edges, unsigned long n) {
+
+    struct EdgeRecordGamma recs[EDGE_RECORD_CHUNK];
+    struct EdgeRecord *rec;
+    struct GNATEdge *edg;
+    struct Synapse syn;
+    unsigned char *out;
+    size_t rec_size;
+    unsigned long first, idx, n_chunk;
+    int with_gamma = (g_writer.fmt == EDGE_BINARY_GAMMA);
+
+    rec_size = EdgeFileRecordSize(with_gamma ? EDGEFILE_GAMMA : 0);
+
+    for (first = 0; first < n; first += n_chunk) {
+        n_chunk = (n - first < EDGE_RECORD_CHUNK) ? n - first : EDGE_RECORD_CHUNK;
+
+        /* records are packed at rec_size, so gamma-less ones overlap the array slots */
+        out = (unsigned char *) recs;
+        for (idx = 0; idx < n_chunk; ++idx) {
+            edg = &edges[first + idx];
+            rec = (struct EdgeRecord *)(out + idx * rec_size);
+            rec->pre_id = edg->pre_id;
+            rec->post_id = edg->post_id;
+            rec->t_pre1 = edg->t_pre1;
+            rec->t_pre2 = edg->t_pre2;
+            rec->t_post1 = edg->t_post1;
+            rec->t_post2 = edg->t_post2;
+            if (with_gamma) {
+                SynapseGet(g_writer.pn, edg->post_id, edg->syn_idx, &syn);
+                recs[idx].gamma1 = compute_gamma_dt((float)(edg->t_post1 - edg->t_pre1), &syn, g_writer.tau);
+                recs[idx].gamma2 = compute_gamma_dt((float)(edg->t_post2 - edg->t_pre2), &syn, g_writer.tau);
+            }
+        }
+
+        if (fwrite(out, rec_size, n_chunk, g_writer.fp) != n_chunk) {
+            printf("FATAL: Unable to write edges\n");
+            exit(-1);
+        }
+    }
+}
+
+/*
+ * Merges the components joined by edges[0..n), writing the edges that
+ * join two components when a spanning forest is wanted
+ */
+static void merge_edge_components(struct GNATEdge *edges, unsigned long n) {
+
+    struct GNATEdge *edg;
+    unsigned long idx;
+
+    for (idx = 0; idx < n; ++idx) {
+        edg = &edges[idx];
+        if (WCCAddEdge(g_writer.wcc, edg->pre_id, edg->t_pre1, edg->t_pre2, edg->post_id, edg->t_post1, edg->t_post2) &&
+            g_writer.fp_forest) {
+            fprint_GNAT_edge(g_writer.fp_forest, edg);
+        }
+    }
 }
 
 /*
- * Opens file fname for writing
- * Zeros edge buffer
+ * Writer thread: writes queued arrays in order and returns them to the pool
  */
-int initialize_edge_buffer(char* fname) {
+static void *edge_writer_main(void *arg) {
+
+    struct GNATEdge *edges;
+    unsigned long n, idx;
+    double t0;
+
+    (void) arg;
+
+    TRACE_THREAD_NAME("writer", -1);
+    PerfThreadBegin("writer", -1);
+
+    pthread_mutex_lock(&g_writer.lock);
+    for (;;) {
+        while (!g_writer.n_full && !g_writer.done) {
+            pthread_cond_wait(&g_writer.cv_full, &g_writer.lock);
+        }
+        if (!g_writer.n_full) break;
+
+        edges = g_writer.full_bufs[g_writer.full_head];
+        n = g_writer.full_sz[g_writer.full_head];
+        g_writer.full_head = (g_writer.full_head + 1) % g_writer.n_bufs;
+        g_writer.n_full--;
+        pthread_mutex_unlock(&g_writer.lock);
+
+        TRACE_BEGIN_ARG("write", "edges", n);
+
+        /* only this thread touches the file */
+        t0 = now_s();
+        if (g_writer.wcc) {
+            merge_edge_components(edges, n);
+        } else if (g_writer.fmt == EDGE_TEXT) {
+            for (idx = 0; idx < n; ++idx) {
+                fprint_GNAT_edge(g_writer.fp, &edges[idx]);
+            }
+        } else {
+            write_edge_records(edges, n);
+        }
+
+        TRACE_END("write");
+
+        pthread_mutex_lock(&g_writer.lock);
+        g_writer.t_write += now_s() - t0;
+        g_writer.n_written += n;
+        g_writer.free_bufs[g_writer.n_free++] = edges;
+        pthread_cond_signal(&g_writer.cv_free);
+    }
+    pthread_mutex_unlock(&g_writer.lock);
+
+    PerfThreadEnd();
+    return NULL;
+}
+
+/*
+ * Takes an array from the pool, waiting for the writer if none is free
+ */
+static struct GNATEdge *edge_writer_take(void) {
+
+    struct GNATEdge *res;
+    double t0;
+
+    pthread_mutex_lock(&g_writer.lock);
+    if (!g_writer.n_free) {
+        t0 = now_s();
+        g_writer.n_blocks++;
+        while (!g_writer.n_free) {
+            pthread_cond_wait(&g_writer.cv_free, &g_writer.lock);
+        }
+        g_writer.t_blocked += now_s() - t0;
+    }
+    res = g_writer.free_bufs[--g_writer.n_free];
+    pthread_mutex_unlock(&g_writer.lock);
+    return res;
+}
+
+/* queues n edges of array edges for writing */
+static void edge_writer_queue(struct GNATEdge *edges, unsigned long n) {
+
+    pthread_mutex_lock(&g_writer.lock);
+    g_writer.full_bufs[(g_writer.full_head + g_writer.n_full) % g_writer.n_bufs] = edges;
+    g_writer.full_sz[(g_writer.full_head + g_writer.n_full) % g_writer.n_bufs] = n;
+    g_writer.n_full++;
+    g_writer.n_swaps++;
+    pthread_cond_signal(&g_writer.cv_full);
+    pthread_mutex_unlock(&g_writer.lock);
+}
+
+/* returns an unused array to the pool */
+static void edge_writer_give(struct GNATEdge *edges) {
+
+    pthread_mutex_lock(&g_writer.lock);
+    g_writer.free_bufs[g_writer.n_free++] = edges;
+    pthread_cond_signal(&g_writer.cv_free);
+    pthread_mutex_unlock(&g_writer.lock);
+}
+
+/*
+ * Opens file fname for writing edges in format fmt and starts the writer
+ * thread with a pool of n_bufs arrays of buf_size edges.  Every search
+ * thread holds one array, so n_bufs beyond the number of search threads
+ * is what lets search and output overlap.
+ * tau and pn are only used for the gamma values of EDGE_BINARY_GAMMA.
+ * In the EDGE_WCC formats fname receives the component labels, written
+ * by finalize_edge_buffer, and EDGE_WCC_FOREST also writes the spanning
+ * forest to WCC_FOREST_FILE.
+ */
+int initialize_edge_buffer(char* fname, enum EdgeFormat fmt, float tau, const struct PhysNetwork *pn, unsigned long buf_size, unsigned long n_bufs) {
+
+    unsigned long idx;
 
     /* attempt to open file */
-    fp_edgbuf = fopen(fname, "w");
-    if (!fp_edgbuf) {
+    memset(&g_writer, 0, sizeof(g_writer));
+    g_writer.fp = fopen(fname, (fmt == EDGE_BINARY || fmt == EDGE_BINARY_GAMMA) ? "wb" : "w");
+    if (!g_writer.fp) {
         printf("FATAL: unable to open output file %s\n", fname);
         exit(-1);
     }
+    g_writer.fmt = fmt;
+    g_writer.tau = tau;
+    g_writer.pn = pn;
+
+    if (fmt == EDGE_WCC || fmt == EDGE_WCC_FOREST) {
+        g_writer.wcc = WCCCreate();
+        if (fmt == EDGE_WCC_FOREST) {
+            g_writer.fp_forest = fopen(WCC_FOREST_FILE, "w");
+            if (!g_writer.fp_forest) {
+                printf("FATAL: unable to open output file %s\n", WCC_FOREST_FILE);
+                exit(-1);
+            }
+        }
+    } else if (fmt != EDGE_TEXT) {
+        EdgeFileWriteHeader(g_writer.fp, (fmt == EDGE_BINARY_GAMMA) ? EDGEFILE_GAMMA : 0);
+    }
 
-    /* clear edge buffer */
-    edgbuf_sz = 0;
-    memset(g_edgbuf, 0, sizeof(g_edgbuf));
+    if (buf_size < 1 || n_bufs < 1) {
+        printf("FATAL: Need at least one edge buffer of at least one edge\n");
+        exit(-1);
+    }
+    g_writer.buf_size = buf_size;
+    g_writer.n_bufs = n_bufs;
+    g_writer.arrays = malloc(n_bufs * sizeof(struct GNATEdge *));
+    g_writer.free_bufs = malloc(n_bufs * sizeof(struct GNATEdge *));
+    g_writer.full_bufs = malloc(n_bufs * sizeof(struct GNATEdge *));
+    g_writer.full_sz = malloc(n_bufs * sizeof(unsigned long));
+    if (!g_writer.arrays || !g_writer.free_bufs || !g_writer.full_bufs || !g_writer.full_sz) {
+        printf("FATAL: Unable to allocate edge buffer pool\n");
+        exit(-1);
+    }
+    for (idx = 0; idx < n_bufs; ++idx) {
+        g_writer.arrays[idx] = malloc(buf_size * sizeof(struct GNATEdge));
+        if (!g_writer.arrays[idx]) {
+            MemFatal("edge buffer storage");
+        }
+        MemAlloc(MEM_EDGE_BUFFER, buf_size * sizeof(struct GNATEdge));
+        g_writer.free_bufs[idx] = g_writer.arrays[idx];
+    }
+    g_writer.n_free = n_bufs;
+
+    pthread_mutex_init(&g_writer.lock, NULL);
+    pthread_cond_init(&g_writer.cv_free, NULL);
+    pthread_cond_init(&g_writer.cv_full, NULL);
+    if (pthread_create(&g_writer.thread, NULL, edge_writer_main, NULL)) {
+        printf("FATAL: Unable to start edge writer thread\n");
+        exit(-1);
+    }
     return 0;
 
 }
 
+/*
+ * Waits for the writer to drain the queue, then closes the output file.
+ * All edge buffers must have been destroyed.
+ */
 void finalize_edge_buffer() {
 
-    flush_edge_buffer();
-    fclose(fp_edgbuf);
+    unsigned long idx, n_comp;
+
+    pthread_mutex_lock(&g_writer.lock);
+    g_writer.done = 1;
+    pthread_cond_signal(&g_writer.cv_full);
+    pthread_mutex_unlock(&g_writer.lock);
+    pthread_join(g_writer.thread, NULL);
+
+    if (g_writer.wcc) {
+        n_comp = WCCWriteLabels(g_writer.wcc, g_writer.fp);
+        printf("Components: %lu spike pairs, %lu edges, %lu components, %lu forest edges\n",
+               g_writer.wcc->n_nodes, g_writer.wcc->n_edges, n_comp, g_writer.wcc->n_unions);
+        WCCDestroy(g_writer.wcc);
+        g_writer.wcc = (struct WCC *) NULL;
+        if (g_writer.fp_forest) {
+            fclose(g_writer.fp_forest);
+            g_writer.fp_forest = (FILE *) NULL;
+        }
+    } else if (g_writer.fmt != EDGE_TEXT) {
+        EdgeFileFinish(g_writer.fp, g_writer.n_written);
+    }
+    fclose(g_writer.fp);
+    g_writer.fp = (FILE *) NULL;
+
+    printf("Edge writer: %lu edges in %lu buffers of %lu, %.3f s writing, %lu waits for a free buffer, %.3f s blocked\n",
+           (unsigned long) g_writer.n_written, g_writer.n_swaps, g_writer.buf_size, g_writer.t_write,
+           g_writer.n_blocks, g_writer.t_blocked);
+
+    for (idx = 0; idx < g_writer.n_bufs; ++idx) {
+        MemFree(MEM_EDGE_BUFFER, g_writer.buf_size * sizeof(struct GNATEdge));
+        free(g_writer.arrays[idx]);
+    }
+    free(g_writer.arrays);
+    free(g_writer.free_bufs);
+    free(g_writer.full_bufs);
+    free(g_writer.full_sz);
+    pthread_mutex_destroy(&g_writer.lock);
+    pthread_cond_destroy(&g_writer.cv_free);
+    pthread_cond_destroy(&g_writer.cv_full);
 }
 
-void flush_edge_buffer() {
+/* edges the writer has taken so far, all of them once finalize_edge_buffer returns */
+uint64_t edges_written(void) {
 
-    unsigned int idx;
+    return g_writer.n_written;
+}
 
-    if (!fp_edgbuf) {
-        printf("FATAL: output file not initialized\n");
+/*
+ * Allocates an empty edge buffer backed by an array from the writer's pool
+ */
+struct EdgeBuffer *EdgeBufferCreate(void) {
+
+    struct EdgeBuffer *res = malloc(sizeof(struct EdgeBuffer));
+    if (!res) {
+        printf("FATAL: Unable to allocate edge buffer\n");
         exit(-1);
     }
 
-    if (edgbuf_sz == 0) return;
+    res->edges = edge_writer_take();
+    res->sz = 0;
+    res->cap = g_writer.buf_size;
+    return res;
+}
 
-    for (idx = 0; idx < edgbuf_sz; ++idx) {
-        fprint_GNAT_edge(fp_edgbuf, &g_edgbuf[idx]);
+/*
+ * Queues any remaining edges and frees the buffer
+ */
+void EdgeBufferDestroy(struct EdgeBuffer *eb) {
+
+    if (!eb) return;
+
+    if (eb->sz) {
+        edge_writer_queue(eb->edges, eb->sz);
+    } else {
+        edge_writer_give(eb->edges);
     }
-    edgbuf_sz = 0;
+    free(eb);
 }
 
+/*
+ * Hands the buffered edges to the writer thread and continues in a free array
+ */
+void flush_edge_buffer(struct EdgeBuffer *eb) {
+
+    if (!g_writer.fp) {
+        printf("FATAL: output file not initialized\n");
+        exit(-1);
+    }
+
+    if (eb->sz == 0) return;
+
+    TRACE_BEGIN_ARG("flush", "edges", eb->sz);
+    edge_writer_queue(eb->edges, eb->sz);
+    eb->edges = edge_writer_take();
+    eb->sz = 0;
+    TRACE_END("flush");
+}
+
+
+void GNAT_add_edge(struct EdgeBuffer *eb, struct Synapse *syn, long t_pre1, long t_pre2, struct SpikePair *spp_post, float cd_ratio) {
 
-static void GNAT_add_edge(struct SpikePair *_spp_pre, struct SpikePair *_spp_post, float _cd_ratio) {
+    GNAT_add_edge_times(eb, syn, t_pre1, t_pre2, spp_post->sp1->n_id, spp_post->sp1->ts, spp_post->sp2->ts, cd_ratio);
+}
+
+void GNAT_add_edge_times(struct EdgeBuffer *eb, struct Synapse *syn, long t_pre1, long t_pre2, uint32_t post_id, long t_post1, long t_post2, float cd_ratio) {
 
+    struct GNATEdge *edg;
 
     /* Check if buffer is full */
-    if (edgbuf_sz >= N_EDGBUF) {
-        flush_edge_buffer();
-        edgbuf_sz = 0;
+    if (eb->sz >= eb->cap) {
+        flush_edge_buffer(eb);
     }
 
-    g_edgbuf[edgbuf_sz].spp_pre = _spp_pre;
-    g_edgbuf[edgbuf_sz].spp_post = _spp_post;
-    g_edgbuf[edgbuf_sz].cd_ratio = _cd_ratio;
-    edgbuf_sz++;
+    edg = &eb->edges[eb->sz];
+    edg->pre_id = syn->src_id;
+    edg->post_id = post_id;
+    edg->t_pre1 = t_pre1;
+    edg->t_pre2 = t_pre2;
+    edg->t_post1 = t_post1;
+    edg->t_post2 = t_post2;
+    edg->cd_ratio = cd_ratio;
+    edg->syn_idx = syn->idx;
+    eb->sz++;
 
 }
 
@@ -155,10 +504,15 @@ float compute_omega(struct Spike *sp_pre, struct Spike *sp_post, struct Synapse
  */
 float compute_gamma(struct Spike *sp_pre, struct Spike *sp_post, struct Synapse *edg, float tau) {
 
-    float gamma, theta;
-    float delta_t;
+    return compute_gamma_dt((float)(sp_post->ts - sp_pre->ts), edg, tau);
+}
 
-    delta_t = (float)(sp_post->ts - sp_pre->ts);
+/*
+ * Gamma for a post spike delta_t after the pre spike
+ */
+float compute_gamma_dt(float delta_t, struct Synapse *edg, float tau) {
+
+    float gamma, theta;
 
     /* heaviside function */
     theta = (delta_t >= edg->delay) ? 0 : 1;
@@ -167,6 +521,64 @@ float compute_gamma(struct Spike *sp_pre, struct Spike *sp_post, struct Synapse
     return gamma;
 }
 
+/*
+ * Computes the causal window of every synapse in pn.
+ *
+ * gamma <= thresh holds exactly when delay <= dt <= delay + tau * (thresh - neg_log_rel_w),
+ * where dt is the post minus pre spike time.  The integer end points are
+ * found from that formula and then nudged so that they agree with
+ * compute_gamma_dt under float rounding.  A positive c_radius further
+ * limits the window to |dt| <= c_radius.
+ */
+void GNAT_compute_windows(struct PhysNetwork *pn, float tau, float thresh, float c_radius) {
+
+    unsigned long idx, pos;
+    struct Synapse syn;
+    long lo, hi, cap;
+
+    for (idx = 0; idx < pn->n_cells; ++idx) {
+        for (pos = pn->offsets[idx]; pos < pn->offsets[idx + 1]; ++pos) {
+
+            SynapseGet(pn, idx, pos, &syn);
+            lo = (long)ceilf(syn.delay);
+            hi = (long)floorf(syn.delay + tau * (thresh - syn.neg_log_rel_w));
+
+            if (compute_gamma_dt((float)lo, &syn, tau) > thresh) {
+                /* nothing ever passes */
+                pn->win_lo[pos] = 0;
+                pn->win_hi[pos] = -1;
+                continue;
+            }
+            if (hi < lo) hi = lo;
+            while (compute_gamma_dt((float)(hi + 1), &syn, tau) <= thresh) hi++;
+            while (compute_gamma_dt((float)hi, &syn, tau) > thresh) hi--;
+
+            if (c_radius > 0) {
+                cap = (long)floorf(c_radius);
+                if (lo < -cap) lo = -cap;
+                if (hi > cap) hi = cap;
+            }
+            if (lo < INT32_MIN || hi > INT32_MAX) {
+                printf("FATAL: Causal window of synapse %lu does not fit in 32 bits\n", pos);
+                exit(-1);
+            }
+            pn->win_lo[pos] = lo;
+            pn->win_hi[pos] = hi;
+        }
+    }
+}
+
+/*
+ * Region of presynaptic pairs that may form an edge with spp_post across syn
+ */
+void GNAT_query_range(struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn) {
+
+    r->x_lo = spp_post->sp1->ts - syn->win_hi;
+    r->x_hi = spp_post->sp1->ts - syn->win_lo;
+    r->y_lo = spp_post->sp2->ts - syn->win_hi;
+    r->y_hi = spp_post->sp2->ts - syn->win_lo;
+}
+
 int GNAT_test_for_edge(struct SpikePair *spp_pre, struct SpikePair *spp_post, struct Synapse *edg, float tau, float thresh) {
 
     float gamma_1, gamma_2;
@@ -177,34 +589,429 @@ int GNAT_test_for_edge(struct SpikePair *spp_pre, struct SpikePair *spp_post, st
     return (gamma_1 <= thresh) && (gamma_2 <= thresh);
 }
 
+/*
+ * Same test as GNAT_test_for_edge for a presynaptic pair given by its spike times
+ */
+int GNAT_test_times(long t_pre1, long t_pre2, struct SpikePair *spp_post, struct Synapse *edg, float tau, float thresh) {
 
-void QTreeMapGNATEdge(struct QuadTree *qt, struct BoundingBox *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta) {
+    float gamma_1, gamma_2;
+
+    gamma_1 = compute_gamma_dt((float)(spp_post->sp1->ts - t_pre1), edg, tau);
+    gamma_2 = compute_gamma_dt((float)(spp_post->sp2->ts - t_pre2), edg, tau);
+
+    return (gamma_1 <= thresh) && (gamma_2 <= thresh);
+}
 
-    /* 
-     * Maps the function func to all elements in the QuadTree qt
-     * that fall within the bounding box r
-     */
+
+/*
+ * TRUE if the pair lies inside the query region.
+ * Inside the causal windows this is the same as passing both gamma tests.
+ */
+static int range_contains(struct QueryRange *r, long t1, long t2) {
+
+    return (t1 >= r->x_lo) && (t1 <= r->x_hi) && (t2 >= r->y_lo) && (t2 <= r->y_hi);
+}
+
+/*
+ * Adds every pair stored in qt and its subtrees as an edge.
+ * Only called for nodes that lie entirely inside the query region.
+ */
+static void QTreeAddAllEdges(struct QuadTree *qt, struct SpikePair *spp_post, struct Synapse *syn, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    struct SpikePair *spp_pre;
+
+    qs->nodes_visited++;
+    for (spp_pre = qt->pairs; spp_pre; spp_pre = spp_pre->next) {
+        GNAT_add_edge(eb, syn, spp_pre->sp1->ts, spp_pre->sp2->ts, spp_post, 1);
+        qs->pairs_bulk++;
+    }
+
+    if (!qt->NW) return;
+
+    QTreeAddAllEdges(qt->NW, spp_post, syn, eb, qs);
+    QTreeAddAllEdges(qt->SW, spp_post, syn, eb, qs);
+    QTreeAddAllEdges(qt->NE, spp_post, syn, eb, qs);
+    QTreeAddAllEdges(qt->SE, spp_post, syn, eb, qs);
+}
+
+static void QTreeMapNode(struct QuadTree *qt, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    struct SpikePair *spp_pre;
+
+    /* Every pair of a node inside the region is an edge */
+    if (BBoxInsideRange(qt->bdry, r)) {
+        QTreeAddAllEdges(qt, spp_post, syn, eb, qs);
+        return;
+    }
+
+    qs->nodes_visited++;
 
     /* If the region does not intersect our BBox, return */
-    if (!BBoxIntersects(qt->bdry, r)) return;
+    if (!BBoxIntersectsRange(qt->bdry, r)) {
+        qs->bbox_rejects++;
+        return;
+    }
 
-    struct SpikePair *spp_pre = qt->pairs;
+    for (spp_pre = qt->pairs; spp_pre; spp_pre = spp_pre->next) {
 
-    while (spp_pre) {
+        /* cheap integer check before the gamma test */
+        qs->pairs_tested++;
+        if (!range_contains(r, spp_pre->sp1->ts, spp_pre->sp2->ts)) continue;
 
-        /* apply func to the spike pair */
+        qs->edge_tests++;
         if (GNAT_test_for_edge(spp_pre, spp_post, syn, tau, theta)) {
             /* add edge */
-            GNAT_add_edge(spp_pre, spp_post, 1);
+            qs->edge_hits++;
+            GNAT_add_edge(eb, syn, spp_pre->sp1->ts, spp_pre->sp2->ts, spp_post, 1);
         }
-        spp_pre = spp_pre->next;
     }
 
     if (!qt->NW) return;
 
-    QTreeMapGNATEdge(qt->NW, r, spp_post, syn, tau, theta);
-    QTreeMapGNATEdge(qt->SW, r, spp_post, syn, tau, theta);
-    QTreeMapGNATEdge(qt->NE, r, spp_post, syn, tau, theta);
-    QTreeMapGNATEdge(qt->SE, r, spp_post, syn, tau, theta);
+    QTreeMapNode(qt->NW, r, spp_post, syn, tau, theta, eb, qs);
+    QTreeMapNode(qt->SW, r, spp_post, syn, tau, theta, eb, qs);
+    QTreeMapNode(qt->NE, r, spp_post, syn, tau, theta, eb, qs);
+    QTreeMapNode(qt->SE, r, spp_post, syn, tau, theta, eb, qs);
+}
+
+void QTreeMapGNATEdge(struct QuadTree *qt, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    /* 
+     * Adds an edge for every spike pair in the QuadTree qt
+     * that falls within the query region r and passes the GNAT test.
+     * Nodes entirely inside r are taken in bulk, pairs of nodes
+     * that only overlap r are checked one by one.
+     */
+
+    qs->n_queries++;
+    QTreeMapNode(qt, r, spp_post, syn, tau, theta, eb, qs);
+}
+
+/* traversal stack entry for the linear quadtree: node and its implicit square */
+struct LQTreeFrame {
+
+    uint32_t node;
+    uint32_t x;
+    uint32_t y;
+    unsigned long size;
+};
+
+/* largest run of leaf pairs handed to the batch test at once */
+#define LQT_BATCH_MAX 1024
+
+/*
+ * Runs the batch test over the pairs first .. first + n - 1, in blocks
+ * of at most LQT_BATCH_MAX, and adds the hits
+ */
+static void LQTreeBatchEdges(struct LQTree *lqt, unsigned long first, unsigned long n,
+                             uint32_t x_lo, uint32_t x_w, uint32_t y_lo, uint32_t y_w,
+                             struct SpikePair *spp_post, struct Synapse *syn, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    uint32_t hits[LQT_BATCH_MAX];
+    unsigned long n_hits, n_block, idx, p;
+
+    qs->pairs_tested += n;
+
+    while (n > 0) {
+        n_block = (n < LQT_BATCH_MAX) ? n : LQT_BATCH_MAX;
+        n_hits = GNAT_batch_test(&lqt->t1[first], &lqt->t2[first], n_block, x_lo, x_w, y_lo, y_w, hits);
+        for (idx = 0; idx < n_hits; ++idx) {
+            p = first + hits[idx];
+            GNAT_add_edge(eb, syn, lqt->t0 + lqt->t1[p], lqt->t0 + lqt->t2[p], spp_post, 1);
+        }
+        first += n_block;
+        n -= n_block;
+    }
+}
+
+/*
+ * Linear quadtree counterpart of QTreeMapGNATEdge
+ *
+ * The tree is walked in Morton order with an explicit stack.  Node
+ * squares are exact integer squares, so a node inside the region
+ * contributes its whole, contiguous pair range as edges.  Leaves that
+ * only overlap the region are usually adjacent in the pair arrays; they
+ * are merged into runs and tested with the batch kernel.
+ * The batch test checks the integer causal window, which is the same
+ * as the gamma test, so syn, tau and theta are not needed here.
+ */
+void LQTreeMapGNATEdge(struct LQTree *lqt, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    struct LQTreeFrame stack[3 * 33 + 1];
+    struct LQTreeFrame f;
+    struct LQTreeNode *n;
+    unsigned long idx, last, half, run_first = 0, run_len = 0;
+    long x_lo, x_hi, y_lo, y_hi, max_off;
+    int top = 0, q;
+
+    (void)syn; (void)tau; (void)theta;
+
+    qs->n_queries++;
+    if (!lqt->n_pairs) return;
+
+    /* region in offsets from the root corner, clipped to the root square */
+    max_off = (long)((1UL << lqt->log2_size) - 1);
+    x_lo = r->x_lo - lqt->t0;
+    x_hi = r->x_hi - lqt->t0;
+    y_lo = r->y_lo - lqt->t0;
+    y_hi = r->y_hi - lqt->t0;
+    if (x_lo < 0) x_lo = 0;
+    if (y_lo < 0) y_lo = 0;
+    if (x_hi > max_off) x_hi = max_off;
+    if (y_hi > max_off) y_hi = max_off;
+    if (x_lo > x_hi || y_lo > y_hi) return;
+
+    stack[top].node = 0;
+    stack[top].x = 0;
+    stack[top].y = 0;
+    stack[top].size = 1UL << lqt->log2_size;
+    top++;
+
+    while (top > 0) {
+
+        f = stack[--top];
+        n = &lqt->nodes[f.node];
+        qs->nodes_visited++;
+
+        if (!n->count) continue;
+
+        /* If the region does not intersect the node's square [x, x + size), skip it */
+        if (x_hi < (long)f.x || x_lo >= (long)(f.x + f.size)) continue;
+        if (y_hi < (long)f.y || y_lo >= (long)(f.y + f.size)) continue;
+
+        last = n->first + n->count;
+
+        /* Every pair of a node inside the region is an edge */
+        if (x_lo <= (long)f.x && (long)(f.x + f.size - 1) <= x_hi &&
+            y_lo <= (long)f.y && (long)(f.y + f.size - 1) <= y_hi) {
+            for (idx = n->first; idx < last; ++idx) {
+                GNAT_add_edge(eb, syn, lqt->t0 + lqt->t1[idx], lqt->t0 + lqt->t2[idx], spp_post, 1);
+            }
+            qs->pairs_bulk += n->count;
+            continue;
+        }
+
+        if (!n->child) {
+            /* extend the current run of partially covered leaves if adjacent */
+            if (run_first + run_len != n->first || run_len + n->count > LQT_BATCH_MAX) {
+                LQTreeBatchEdges(lqt, run_first, run_len, x_lo, x_hi - x_lo, y_lo, y_hi - y_lo, spp_post, syn, eb, qs);
+                run_first = n->first;
+                run_len = 0;
+            }
+            run_len += n->count;
+            continue;
+        }
+
+        /* children are in Morton order: quadrant q = x_bit | (y_bit << 1), pushed so that 0 pops first */
+        half = f.size >> 1;
+        for (q = 3; q >= 0; --q) {
+            stack[top].node = n->child + q;
+            stack[top].x = f.x + (q & 1) * half;
+            stack[top].y = f.y + (q >> 1) * half;
+            stack[top].size = half;
+            top++;
+        }
+    }
+
+    LQTreeBatchEdges(lqt, run_first, run_len, x_lo, x_hi - x_lo, y_lo, y_hi - y_lo, spp_post, syn, eb, qs);
+}
+
+
+/*
+ * Index of the first element of the sorted array ts[0..n) not less than t
+ */
+static unsigned long spike_lower_bound(const long *ts, unsigned long n, long t) {
+
+    unsigned long lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ts[mid] < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Index of the first element of the sorted array ts[0..n) greater than t
+ */
+static unsigned long spike_upper_bound(const long *ts, unsigned long n, long t) {
+
+    unsigned long lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ts[mid] <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Narrows [*lo, *hi) to the presynaptic spikes whose gamma onto the post
+ * spike at t_post passes thresh.  Gamma only grows with the time difference
+ * once the delay has elapsed, so the passing spikes are contiguous.
+ * Returns FALSE if none pass.
+ */
+static int causal_subrange(const long *ts, unsigned long *lo, unsigned long *hi, long t_post, struct Synapse *syn, float tau, float thresh) {
+
+    unsigned long first = *hi, last = *hi, idx;
+
+    for (idx = *lo; idx < *hi; ++idx) {
+        if (compute_gamma_dt((float)(t_post - ts[idx]), syn, tau) <= thresh) {
+            if (first == *hi) first = idx;
+            last = idx + 1;
+        }
+    }
+    *lo = first;
+    *hi = last;
+    return first < last;
+}
+
+/*
+ * Pair-free counterpart of QTreeMapGNATEdge
+ *
+ * Instead of querying an index of presynaptic spike pairs, the
+ * presynaptic spikes near each post spike are found by binary search in
+ * the presynaptic neuron's sorted spike times pre_ts[0..n_pre).  Both
+ * gamma tests only depend on one spike of the pair each, so the two
+ * ranges are filtered separately and every remaining cross pair is an edge.
+ */
+void PairFreeMapGNATEdge(const long *pre_ts, unsigned long n_pre, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    unsigned long a_lo, a_hi, b_lo, b_hi, i, j;
+
+    qs->n_queries++;
+
+    /* presynaptic spikes inside the query region around each post spike */
+    a_lo = spike_lower_bound(pre_ts, n_pre, r->x_lo);
+    a_hi = spike_upper_bound(pre_ts, n_pre, r->x_hi);
+    if (!causal_subrange(pre_ts, &a_lo, &a_hi, spp_post->sp1->ts, syn, tau, theta)) return;
+
+    b_lo = spike_lower_bound(pre_ts, n_pre, r->y_lo);
+    b_hi = spike_upper_bound(pre_ts, n_pre, r->y_hi);
+    if (!causal_subrange(pre_ts, &b_lo, &b_hi, spp_post->sp2->ts, syn, tau, theta)) return;
+
+    /* a pair is two distinct spikes in time order */
+    for (i = a_lo; i < a_hi; ++i) {
+        for (j = (b_lo > i + 1) ? b_lo : i + 1; j < b_hi; ++j) {
+            if (pre_ts[i] == pre_ts[j]) continue;
+            GNAT_add_edge(eb, syn, pre_ts[i], pre_ts[j], spp_post, 1);
+            qs->pairs_bulk++;
+        }
+    }
+}
+
+
+/*
+ * Self-join engine
+ *
+ * A second order edge (pre pair -> post pair) across a synapse exists
+ * exactly when both pre -> post spike links are first order causal links
+ * across that synapse.  The links of every post spike are found once,
+ * as a contiguous range of presynaptic spikes, and edges are formed by
+ * pairing up post spikes that have links.  The work grows with the
+ * number of causal links rather than with the number of spike pairs.
+ */
+
+struct CausalLinks *CausalLinksCreate(void) {
+
+    struct CausalLinks *res = calloc(1, sizeof(struct CausalLinks));
+    if (!res) {
+        printf("FATAL: Unable to allocate causal links\n");
+        exit(-1);
+    }
+    return res;
+}
+
+void CausalLinksDestroy(struct CausalLinks *cl) {
+
+    if (!cl) return;
+
+    free(cl->post);
+    free(cl->lo);
+    free(cl->hi);
+    free(cl);
+}
+
+static void CausalLinksReserve(struct CausalLinks *cl, unsigned long n) {
+
+    if (n <= cl->cap) return;
+
+    cl->cap = n;
+    cl->post = realloc(cl->post, n * sizeof(unsigned long));
+    cl->lo = realloc(cl->lo, n * sizeof(unsigned long));
+    cl->hi = realloc(cl->hi, n * sizeof(unsigned long));
+    if (!cl->post || !cl->lo || !cl->hi) {
+        printf("FATAL: Unable to allocate causal links\n");
+        exit(-1);
+    }
+}
 
+/*
+ * Finds the first order causal links across syn onto the post spikes
+ * post_ts[i_first..n_post).  Post spike i is linked to the presynaptic
+ * spikes pre_ts[lo..hi) whose time difference lies in the synapse's
+ * causal window.  Both spike lists are sorted, so the window bounds are
+ * advanced in a single sweep after one binary search.
+ */
+void GNAT_find_causal_links(struct CausalLinks *cl, const long *post_ts, unsigned long n_post, unsigned long i_first,
+                            const long *pre_ts, unsigned long n_pre, struct Synapse *syn) {
+
+    unsigned long i, lo, hi;
+
+    cl->n = 0;
+    if (i_first >= n_post || !n_pre) return;
+
+    CausalLinksReserve(cl, n_post - i_first);
+
+    lo = spike_lower_bound(pre_ts, n_pre, post_ts[i_first] - syn->win_hi);
+    hi = lo;
+    for (i = i_first; i < n_post; ++i) {
+        while (lo < n_pre && pre_ts[lo] < post_ts[i] - syn->win_hi) lo++;
+        if (hi < lo) hi = lo;
+        while (hi < n_pre && pre_ts[hi] <= post_ts[i] - syn->win_lo) hi++;
+        if (hi > lo) {
+            cl->post[cl->n] = i;
+            cl->lo[cl->n] = lo;
+            cl->hi[cl->n] = hi;
+            cl->n++;
+        }
+    }
+}
+
+/*
+ * Emits the second order edges across syn onto post_id formed by two
+ * linked post spikes, the first of which lies in [i_first, i_first + n_a).
+ */
+void SelfJoinGNATEdges(struct CausalLinks *cl, uint32_t post_id, const long *post_ts, unsigned long i_first, unsigned long n_a,
+                       const long *pre_ts, struct Synapse *syn, struct EdgeBuffer *eb, struct QueryStats *qs) {
+
+    unsigned long a, b, p, q, q_first;
+
+    qs->n_queries++;
+
+    for (a = 0; a < cl->n && cl->post[a] < i_first + n_a; ++a) {
+        for (b = a + 1; b < cl->n; ++b) {
+
+            /* a post pair is two distinct spikes */
+            if (post_ts[cl->post[a]] == post_ts[cl->post[b]]) continue;
+
+            /* and so is a pre pair */
+            for (p = cl->lo[a]; p < cl->hi[a]; ++p) {
+                q_first = (cl->lo[b] > p + 1) ? cl->lo[b] : p + 1;
+                for (q = q_first; q < cl->hi[b]; ++q) {
+                    if (pre_ts[p] == pre_ts[q]) continue;
+                    GNAT_add_edge_times(eb, syn, pre_ts[p], pre_ts[q], post_id, post_ts[cl->post[a]], post_ts[cl->post[b]], 1);
+                    qs->pairs_bulk++;
+                }
+            }
+        }
+    }
 }
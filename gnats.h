@@ -26,22 +26,95 @@
 
 #ifndef GNATS_H
 #define GNATS_H
-#define N_EDGBUF 8192 /* size of the GNAT edge buffer */
+#define N_EDGBUF 8192 /* default number of edges per GNAT edge buffer */
 
+/*
+ * Edges are stored by value so that they do not depend on
+ * how an index holds its spike pairs.
+ */
 struct GNATEdge {
 
-    struct SpikePair *spp_pre;
-    struct SpikePair *spp_post;
-    float cd_ratio; /* causal distance ratio */
+    uint32_t pre_id;  /* presynaptic neuron id */
+    uint32_t post_id; /* postsynaptic neuron id */
+    long t_pre1;      /* earlier presynaptic spike time */
+    long t_pre2;      /* later presynaptic spike time */
+    long t_post1;     /* earlier postsynaptic spike time */
+    long t_post2;     /* later postsynaptic spike time */
+    float cd_ratio;   /* causal distance ratio */
+    unsigned long syn_idx; /* network index of the synapse the edge crosses */
+};
+
+/* output file formats */
+enum EdgeFormat {
+    EDGE_TEXT,         /* one line of decimal integers per edge */
+    EDGE_BINARY,       /* edgefile.h records */
+    EDGE_BINARY_GAMMA, /* edgefile.h records with gamma values */
+    EDGE_WCC,          /* no edges, component label of every spike pair */
+    EDGE_WCC_FOREST    /* component labels and a spanning forest of the edges */
+};
+
+#define WCC_FOREST_FILE "gnat2_forest.txt"
+
+/*
+ * Edge buffer owned by a single search thread.
+ * Flushing hands edges to the writer thread and swaps in a free array.
+ */
+struct EdgeBuffer {
+
+    struct GNATEdge *edges;
+    unsigned long sz;  /* number of edges currently in buffer */
+    unsigned long cap; /* capacity of the buffer */
+};
+
+/*
+ * Search work counters, kept per thread and summed at the end
+ */
+struct QueryStats {
+
+    unsigned long n_queries;     /* index queries issued */
+    unsigned long nodes_visited; /* index nodes visited */
+    unsigned long pairs_tested;  /* pairs checked one by one */
+    unsigned long pairs_bulk;    /* pairs taken as edges without a check */
+    unsigned long bbox_rejects;  /* index nodes outside the query region */
+    unsigned long edge_tests;    /* GNAT_test_for_edge calls */
+    unsigned long edge_hits;     /* GNAT_test_for_edge calls that found an edge */
+};
+
+/*
+ * First order causal links of a range of post spikes across one synapse.
+ * Link k joins post spike post[k] to the presynaptic spikes lo[k] .. hi[k] - 1.
+ */
+struct CausalLinks {
+
+    unsigned long n;
+    unsigned long cap;
+    unsigned long *post;
+    unsigned long *lo;
+    unsigned long *hi;
 };
 
 void finalize_edge_buffer();
-int initialize_edge_buffer(char* fname);
-void QTreeMapGNATEdge(struct QuadTree *qt, struct BoundingBox *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta);
+int initialize_edge_buffer(char* fname, enum EdgeFormat fmt, float tau, const struct PhysNetwork *pn, unsigned long buf_size, unsigned long n_bufs);
+uint64_t edges_written(void);
+struct EdgeBuffer *EdgeBufferCreate(void);
+void EdgeBufferDestroy(struct EdgeBuffer *eb);
+void GNAT_add_edge(struct EdgeBuffer *eb, struct Synapse *syn, long t_pre1, long t_pre2, struct SpikePair *spp_post, float cd_ratio);
+void GNAT_add_edge_times(struct EdgeBuffer *eb, struct Synapse *syn, long t_pre1, long t_pre2, uint32_t post_id, long t_post1, long t_post2, float cd_ratio);
+void QTreeMapGNATEdge(struct QuadTree *qt, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs);
+void LQTreeMapGNATEdge(struct LQTree *lqt, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs);
+void PairFreeMapGNATEdge(const long *pre_ts, unsigned long n_pre, struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn, float tau, float theta, struct EdgeBuffer *eb, struct QueryStats *qs);
+void GNAT_compute_windows(struct PhysNetwork *pn, float tau, float thresh, float c_radius);
+void GNAT_query_range(struct QueryRange *r, struct SpikePair *spp_post, struct Synapse *syn);
+struct CausalLinks *CausalLinksCreate(void);
+void CausalLinksDestroy(struct CausalLinks *cl);
+void GNAT_find_causal_links(struct CausalLinks *cl, const long *post_ts, unsigned long n_post, unsigned long i_first, const long *pre_ts, unsigned long n_pre, struct Synapse *syn);
+void SelfJoinGNATEdges(struct CausalLinks *cl, uint32_t post_id, const long *post_ts, unsigned long i_first, unsigned long n_a, const long *pre_ts, struct Synapse *syn, struct EdgeBuffer *eb, struct QueryStats *qs);
 int GNAT_test_for_edge(struct SpikePair *spp_pre, struct SpikePair *spp_post, struct Synapse *edg, float tau, float thresh);
+int GNAT_test_times(long t_pre1, long t_pre2, struct SpikePair *spp_post, struct Synapse *edg, float tau, float thresh);
 float compute_gamma(struct Spike *sp_pre, struct Spike *sp_post, struct Synapse *edg, float tau);
+float compute_gamma_dt(float delta_t, struct Synapse *edg, float tau);
 float compute_omega(struct Spike *sp_pre, struct Spike *sp_post, struct Synapse *edg, float tau);
-void flush_edge_buffer();
+void flush_edge_buffer(struct EdgeBuffer *eb);
 void fprint_GNAT_edge(FILE *fp, struct GNATEdge *edg);
 
 #endif
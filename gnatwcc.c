@@ -0,0 +1,788 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * gnatwcc: weakly connected components of an existing gnat2_out.txt
+ * edge file, in bounded memory.
+ *
+ * The edge file is never held in memory.  Spike pair keys are assigned
+ * dense ids by hash partitioning them to temporary files, and the edges
+ * are then replayed from further temporary files into a union-find over
+ * those ids.  Only the union-find (8 bytes per spike pair) has to fit in
+ * three quarters of the memory budget, which makes the algorithm
+ * semi-external.
+ *
+ *   pass 1  parse the edge file in parallel, writing both endpoints of
+ *           every edge to the partition of their key's hash
+ *   pass 2  sort each partition, number its distinct keys, and write the
+ *           id of every endpoint to the bucket of its edge
+ *   pass 3  load each bucket of edges and merge their endpoints in a
+ *           shared lock free union-find
+ *   pass 4  merge the sorted partitions and write one label per spike pair
+ *
+ * The output has the format of gnatfinder -f wcc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define WCC_LABEL_FLAG (1ULL << 63) /* root slot holds a component label */
+
+/* an endpoint of an edge, pass 1 -> pass 2 */
+struct EndpointRec {
+
+    int64_t t1;
+    int64_t t2;
+    uint32_t cell;
+    uint32_t pad;
+    uint64_t endpoint; /* 2 * edge index + 0 for the pre pair, 1 for the post pair */
+};
+
+/* a distinct spike pair of a partition, in key order, pass 2 -> pass 4 */
+struct KeyRec {
+
+    int64_t t1;
+    int64_t t2;
+    uint32_t cell;
+    uint32_t pad;
+};
+
+/* the node id of an endpoint, pass 2 -> pass 3 */
+struct MapRec {
+
+    uint64_t endpoint;
+    uint32_t part;  /* partition of the key */
+    uint32_t local; /* id of the key within its partition */
+};
+
+/*
+ * Temporary file shared by all threads, appended to under a lock
+ */
+struct SpillFile {
+
+    FILE *fp;
+    pthread_mutex_t lock;
+};
+
+struct WCCJob {
+
+    int n_threads;
+    size_t budget;        /* bytes */
+    const char *tmp_dir;
+
+    /* input */
+    const char *map;
+    size_t size;
+    size_t *chunk_start;  /* n_threads + 1 line aligned offsets */
+    uint64_t *chunk_base; /* first edge index of each chunk */
+    uint64_t n_edges;
+
+    unsigned long n_parts;
+    struct SpillFile *parts;
+    unsigned long n_buckets;
+    uint64_t bucket_edges; /* edges per bucket */
+    struct SpillFile *buckets;
+    unsigned long buf_recs; /* records buffered per thread and spill file */
+
+    uint64_t *part_base; /* first node id of each partition */
+    uint64_t n_nodes;
+    _Atomic uint64_t *parent;
+
+    atomic_ulong next; /* next partition or bucket to take */
+};
+
+struct WCCWorker {
+
+    pthread_t thread;
+    int id;
+    struct WCCJob *job;
+};
+
+static double now_s(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static uint64_t key_hash(uint32_t cell, int64_t t1, int64_t t2) {
+
+    uint64_t h = cell * 0x9E3779B97F4A7C15ULL;
+
+    h ^= (uint64_t) t1 + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= (uint64_t) t2 + 0x85EBCA77C2B2AE63ULL + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int compare_keys(int64_t t1a, int64_t t2a, uint32_t ca, int64_t t1b, int64_t t2b, uint32_t cb) {
+
+    if (ca != cb) return (ca < cb) ? -1 : 1;
+    if (t1a != t1b) return (t1a < t1b) ? -1 : 1;
+    if (t2a != t2b) return (t2a < t2b) ? -1 : 1;
+    return 0;
+}
+
+static int compare_endpoints(const void *pa, const void *pb) {
+
+    const struct EndpointRec *a = pa, *b = pb;
+
+    return compare_keys(a->t1, a->t2, a->cell, b->t1, b->t2, b->cell);
+}
+
+static void *xmalloc(size_t size, const char *what) {
+
+    void *res = malloc(size ? size : 1);
+    if (!res) {
+        printf("FATAL: Unable to allocate %s\n", what);
+        exit(-1);
+    }
+    return res;
+}
+
+/*
+ * Temporary files
+ */
+
+static void spill_name(char *buf, size_t len, const char *dir, char kind, unsigned long idx) {
+
+    snprintf(buf, len, "%s/gnatwcc_%d_%c%lu.tmp", dir, (int) getpid(), kind, idx);
+}
+
+static void spill_open(struct SpillFile *sf, const char *dir, char kind, unsigned long idx, const char *mode) {
+
+    char fname[4096];
+
+    spill_name(fname, sizeof(fname), dir, kind, idx);
+    sf->fp = fopen(fname, mode);
+    if (!sf->fp) {
+        printf("FATAL: Unable to open temporary file %s\n", fname);
+        exit(-1);
+    }
+    pthread_mutex_init(&sf->lock, NULL);
+}
+
+static void spill_append(struct SpillFile *sf, const void *recs, size_t rec_size, size_t n) {
+
+    if (!n) return;
+
+    pthread_mutex_lock(&sf->lock);
+    if (fwrite(recs, rec_size, n, sf->fp) != n) {
+        printf("FATAL: Unable to write temporary file\n");
+        exit(-1);
+    }
+    pthread_mutex_unlock(&sf->lock);
+}
+
+/* reads back a whole temporary file and deletes it, returning its record count */
+static void *spill_load(const char *dir, char kind, unsigned long idx, size_t rec_size, size_t *n_recs) {
+
+    char fname[4096];
+    struct stat st;
+    void *res;
+    FILE *fp;
+
+    spill_name(fname, sizeof(fname), dir, kind, idx);
+    fp = fopen(fname, "rb");
+    if (!fp || fstat(fileno(fp), &st)) {
+        printf("FATAL: Unable to read temporary file %s\n", fname);
+        exit(-1);
+    }
+    *n_recs = st.st_size / rec_size;
+    res = xmalloc(*n_recs * rec_size, "partition");
+    if (fread(res, rec_size, *n_recs, fp) != *n_recs) {
+        printf("FATAL: Unable to read temporary file %s\n", fname);
+        exit(-1);
+    }
+    fclose(fp);
+    unlink(fname);
+    return res;
+}
+
+/* deletes the temporary files of one kind */
+static void spill_remove(const char *dir, char kind, unsigned long n) {
+
+    char fname[4096];
+    unsigned long idx;
+
+    for (idx = 0; idx < n; ++idx) {
+        spill_name(fname, sizeof(fname), dir, kind, idx);
+        unlink(fname);
+    }
+}
+
+/*
+ * Pass 1: parse
+ */
+
+/* parses a decimal integer at *p, leaving *p past it */
+static int parse_long(const char **p, const char *end, int64_t *val) {
+
+    const char *s = *p;
+    int64_t v = 0;
+    int neg = 0;
+
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+    if (s < end && *s == '-') {
+        neg = 1;
+        s++;
+    }
+    if (s >= end || *s < '0' || *s > '9') return 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = 10 * v + (*s - '0');
+        s++;
+    }
+    *val = neg ? -v : v;
+    *p = s;
+    return 1;
+}
+
+static void *count_worker(void *arg) {
+
+    struct WCCWorker *w = arg;
+    struct WCCJob *job = w->job;
+    const char *p = job->map + job->chunk_start[w->id];
+    const char *end = job->map + job->chunk_start[w->id + 1];
+    uint64_t n = 0;
+
+    while (p < end && (p = memchr(p, '\n', end - p))) {
+        n++;
+        p++;
+    }
+    /* a last line without a newline */
+    if (end > job->map + job->chunk_start[w->id] && end[-1] != '\n') n++;
+
+    job->chunk_base[w->id + 1] = n;
+    return NULL;
+}
+
+static void *partition_worker(void *arg) {
+
+    struct WCCWorker *w = arg;
+    struct WCCJob *job = w->job;
+    const char *p = job->map + job->chunk_start[w->id];
+    const char *end = job->map + job->chunk_start[w->id + 1];
+    struct EndpointRec *bufs, *rec;
+    unsigned long *fill, part, idx;
+    uint64_t edge = job->chunk_base[w->id];
+    int64_t f[6];
+    int side;
+
+    bufs = xmalloc(job->n_parts * job->buf_recs * sizeof(struct EndpointRec), "partition buffers");
+    fill = calloc(job->n_parts, sizeof(unsigned long));
+    if (!fill) {
+        printf("FATAL: Unable to allocate partition buffers\n");
+        exit(-1);
+    }
+
+    while (p < end) {
+        for (idx = 0; idx < 6; ++idx) {
+            if (!parse_long(&p, end, &f[idx])) {
+                printf("FATAL: Malformed edge on line %lu\n", (unsigned long) edge + 1);
+                exit(-1);
+            }
+        }
+        p = memchr(p, '\n', end - p);
+        p = p ? p + 1 : end;
+
+        for (side = 0; side < 2; ++side) {
+            part = key_hash((uint32_t) f[3 * side], f[3 * side + 1], f[3 * side + 2]) % job->n_parts;
+            rec = &bufs[part * job->buf_recs + fill[part]];
+            rec->cell = (uint32_t) f[3 * side];
+            rec->t1 = f[3 * side + 1];
+            rec->t2 = f[3 * side + 2];
+            rec->pad = 0;
+            rec->endpoint = 2 * edge + side;
+            if (++fill[part] == job->buf_recs) {
+                spill_append(&job->parts[part], &bufs[part * job->buf_recs], sizeof(struct EndpointRec), fill[part]);
+                fill[part] = 0;
+            }
+        }
+        edge++;
+    }
+
+    for (part = 0; part < job->n_parts; ++part) {
+        spill_append(&job->parts[part], &bufs[part * job->buf_recs], sizeof(struct EndpointRec), fill[part]);
+    }
+    free(bufs);
+    free(fill);
+    return NULL;
+}
+
+/*
+ * Pass 2: number the distinct keys of each partition
+ */
+
+static void *number_worker(void *arg) {
+
+    struct WCCWorker *w = arg;
+    struct WCCJob *job = w->job;
+    struct EndpointRec *recs;
+    struct MapRec *bufs, *m;
+    struct KeyRec key;
+    struct SpillFile keys;
+    unsigned long part, *fill, bkt;
+    size_t n, idx;
+    uint32_t local;
+    int is_new;
+
+    bufs = xmalloc(job->n_buckets * job->buf_recs * sizeof(struct MapRec), "bucket buffers");
+    fill = calloc(job->n_buckets, sizeof(unsigned long));
+    if (!fill) {
+        printf("FATAL: Unable to allocate bucket buffers\n");
+        exit(-1);
+    }
+
+    while ((part = atomic_fetch_add(&job->next, 1)) < job->n_parts) {
+
+        recs = spill_load(job->tmp_dir, 'p', part, sizeof(struct EndpointRec), &n);
+        qsort(recs, n, sizeof(struct EndpointRec), compare_endpoints);
+
+        spill_open(&keys, job->tmp_dir, 'k', part, "wb");
+        local = 0;
+        for (idx = 0; idx < n; ++idx) {
+            is_new = !idx || compare_endpoints(&recs[idx - 1], &recs[idx]);
+            if (is_new) {
+                if (idx) local++;
+                key.cell = recs[idx].cell;
+                key.t1 = recs[idx].t1;
+                key.t2 = recs[idx].t2;
+                key.pad = 0;
+                if (fwrite(&key, sizeof(key), 1, keys.fp) != 1) {
+                    printf("FATAL: Unable to write temporary file\n");
+                    exit(-1);
+                }
+            }
+
+            bkt = recs[idx].endpoint / (2 * job->bucket_edges);
+            m = &bufs[bkt * job->buf_recs + fill[bkt]];
+            m->endpoint = recs[idx].endpoint;
+            m->part = part;
+            m->local = local;
+            if (++fill[bkt] == job->buf_recs) {
+                spill_append(&job->buckets[bkt], &bufs[bkt * job->buf_recs], sizeof(struct MapRec), fill[bkt]);
+                fill[bkt] = 0;
+            }
+        }
+        fclose(keys.fp);
+        pthread_mutex_destroy(&keys.lock);
+
+        /* distinct keys, turned into the first node id after all partitions are done */
+        job->part_base[part + 1] = n ? (uint64_t) local + 1 : 0;
+        free(recs);
+    }
+
+    for (bkt = 0; bkt < job->n_buckets; ++bkt) {
+        spill_append(&job->buckets[bkt], &bufs[bkt * job->buf_recs], sizeof(struct MapRec), fill[bkt]);
+    }
+    free(bufs);
+    free(fill);
+    return NULL;
+}
+
+/*
+ * Pass 3: lock free union-find.  A root is only ever linked to a root of
+ * smaller id, by compare and swap, so the final components do not depend
+ * on how the threads interleave.
+ */
+
+static uint64_t uf_find(_Atomic uint64_t *parent, uint64_t x) {
+
+    uint64_t p, gp;
+
+    for (;;) {
+        p = atomic_load_explicit(&parent[x], memory_order_relaxed);
+        if (p == x) return x;
+        gp = atomic_load_explicit(&parent[p], memory_order_relaxed);
+        /* halve the path, harmless if another thread got there first */
+        if (gp != p) atomic_compare_exchange_weak_explicit(&parent[x], &p, gp, memory_order_relaxed, memory_order_relaxed);
+        x = gp;
+    }
+}
+
+static void uf_union(_Atomic uint64_t *parent, uint64_t a, uint64_t b) {
+
+    uint64_t ra, rb, tmp;
+
+    for (;;) {
+        ra = uf_find(parent, a);
+        rb = uf_find(parent, b);
+        if (ra == rb) return;
+        if (ra < rb) {
+            tmp = ra;
+            ra = rb;
+            rb = tmp;
+        }
+        tmp = ra;
+        if (atomic_compare_exchange_strong(&parent[ra], &tmp, rb)) return;
+    }
+}
+
+static void *union_worker(void *arg) {
+
+    struct WCCWorker *w = arg;
+    struct WCCJob *job = w->job;
+    struct MapRec *recs;
+    uint64_t *ids, first, n_ep;
+    unsigned long bkt;
+    size_t n, idx;
+
+    ids = xmalloc(2 * job->bucket_edges * sizeof(uint64_t), "bucket");
+
+    while ((bkt = atomic_fetch_add(&job->next, 1)) < job->n_buckets) {
+
+        recs = spill_load(job->tmp_dir, 'b', bkt, sizeof(struct MapRec), &n);
+        first = 2 * bkt * job->bucket_edges;
+        n_ep = 0;
+        for (idx = 0; idx < n; ++idx) {
+            ids[recs[idx].endpoint - first] = job->part_base[recs[idx].part] + recs[idx].local;
+            if (recs[idx].endpoint - first + 1 > n_ep) n_ep = recs[idx].endpoint - first + 1;
+        }
+        free(recs);
+
+        for (idx = 0; idx + 1 < n_ep; idx += 2) {
+            uf_union(job->parent, ids[idx], ids[idx + 1]);
+        }
+    }
+    free(ids);
+    return NULL;
+}
+
+static void *compress_worker(void *arg) {
+
+    struct WCCWorker *w = arg;
+    struct WCCJob *job = w->job;
+    uint64_t x, lo, hi;
+
+    lo = job->n_nodes * w->id / job->n_threads;
+    hi = job->n_nodes * (w->id + 1) / job->n_threads;
+    for (x = lo; x < hi; ++x) {
+        atomic_store_explicit(&job->parent[x], uf_find(job->parent, x), memory_order_relaxed);
+    }
+    return NULL;
+}
+
+/*
+ * Pass 4: write labels in key order
+ */
+
+struct KeyReader {
+
+    FILE *fp;
+    struct KeyRec key;
+    uint64_t id;
+    int live;
+};
+
+static void key_reader_next(struct KeyReader *kr) {
+
+    if (kr->live && fread(&kr->key, sizeof(struct KeyRec), 1, kr->fp) == 1) {
+        kr->id++;
+        return;
+    }
+    kr->live = 0;
+}
+
+/* sifts heap slot idx down, ordering readers by their current key */
+static void heap_down(struct KeyReader **heap, unsigned long n, unsigned long idx) {
+
+    unsigned long c;
+    struct KeyReader *tmp;
+
+    for (;;) {
+        c = 2 * idx + 1;
+        if (c >= n) return;
+        if (c + 1 < n && compare_keys(heap[c + 1]->key.t1, heap[c + 1]->key.t2, heap[c + 1]->key.cell,
+                                      heap[c]->key.t1, heap[c]->key.t2, heap[c]->key.cell) < 0) c++;
+        if (compare_keys(heap[c]->key.t1, heap[c]->key.t2, heap[c]->key.cell,
+                         heap[idx]->key.t1, heap[idx]->key.t2, heap[idx]->key.cell) >= 0) return;
+        tmp = heap[c];
+        heap[c] = heap[idx];
+        heap[idx] = tmp;
+        idx = c;
+    }
+}
+
+static uint64_t write_labels(struct WCCJob *job, FILE *out) {
+
+    struct KeyReader *readers, **heap;
+    unsigned long part, n_heap = 0, idx;
+    uint64_t root, v, label, n_comp = 0;
+    char fname[4096];
+
+    readers = xmalloc(job->n_parts * sizeof(struct KeyReader), "key readers");
+    heap = xmalloc(job->n_parts * sizeof(struct KeyReader *), "key readers");
+
+    for (part = 0; part < job->n_parts; ++part) {
+        spill_name(fname, sizeof(fname), job->tmp_dir, 'k', part);
+        readers[part].fp = fopen(fname, "rb");
+        if (!readers[part].fp) {
+            printf("FATAL: Unable to read temporary file %s\n", fname);
+            exit(-1);
+        }
+        unlink(fname);
+        readers[part].id = job->part_base[part] - 1;
+        readers[part].live = 1;
+        key_reader_next(&readers[part]);
+        if (readers[part].live) heap[n_heap++] = &readers[part];
+    }
+    for (idx = n_heap; idx-- > 0; ) heap_down(heap, n_heap, idx);
+
+    while (n_heap) {
+        struct KeyReader *kr = heap[0];
+
+        /* every slot holds its root; a root's slot becomes its label once seen */
+        v = job->parent[kr->id];
+        if (v & WCC_LABEL_FLAG) {
+            label = v & ~WCC_LABEL_FLAG;
+        } else {
+            root = v;
+            v = job->parent[root];
+            if (v & WCC_LABEL_FLAG) {
+                label = v & ~WCC_LABEL_FLAG;
+            } else {
+                label = n_comp++;
+                job->parent[root] = label | WCC_LABEL_FLAG;
+            }
+        }
+        fprintf(out, "%u %ld %ld %lu\n", kr->key.cell, (long) kr->key.t1, (long) kr->key.t2, (unsigned long) label);
+
+        key_reader_next(kr);
+        if (!kr->live) heap[0] = heap[--n_heap];
+        heap_down(heap, n_heap, 0);
+    }
+
+    for (part = 0; part < job->n_parts; ++part) {
+        fclose(readers[part].fp);
+    }
+    free(readers);
+    free(heap);
+    return n_comp;
+}
+
+static void run_workers(struct WCCJob *job, struct WCCWorker *workers, void *(*fn)(void *)) {
+
+    int idx;
+
+    for (idx = 0; idx < job->n_threads; ++idx) {
+        if (pthread_create(&workers[idx].thread, NULL, fn, &workers[idx])) {
+            printf("FATAL: Unable to start thread %d\n", idx);
+            exit(-1);
+        }
+    }
+    for (idx = 0; idx < job->n_threads; ++idx) {
+        pthread_join(workers[idx].thread, NULL);
+    }
+}
+
+static void usage(const char *progname) {
+
+    printf("Usage: %s [-t n_threads] [-m budget_MB] [-d tmp_dir] <edge file> <label file>\n", progname);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+
+    struct WCCJob job;
+    struct WCCWorker *workers;
+    struct stat st;
+    unsigned long idx, budget_mb = 1024;
+    uint64_t n_comp, per_thread;
+    double t0;
+    FILE *out;
+    int fd, opt;
+
+    memset(&job, 0, sizeof(job));
+    job.n_threads = 1;
+    job.tmp_dir = ".";
+
+    while ((opt = getopt(argc, argv, "t:m:d:")) != -1) {
+        switch (opt) {
+            case 't':
+                job.n_threads = strtol(optarg, NULL, 0);
+                break;
+            case 'm':
+                budget_mb = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                job.tmp_dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+    }
+    if (job.n_threads < 1 || budget_mb < 1) {
+        printf("FATAL: Need at least one thread and 1 MB of memory\n");
+        exit(-1);
+    }
+    job.budget = budget_mb << 20;
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        printf("FATAL: Unable to open edge file %s\n", argv[optind]);
+        exit(-1);
+    }
+    job.size = st.st_size;
+    job.map = job.size ? mmap(NULL, job.size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    if (job.map == MAP_FAILED) {
+        printf("FATAL: Unable to map edge file %s\n", argv[optind]);
+        exit(-1);
+    }
+    if (job.size) madvise((void *) job.map, job.size, MADV_SEQUENTIAL);
+
+    out = fopen(argv[optind + 1], "w");
+    if (!out) {
+        printf("FATAL: Unable to open output file %s\n", argv[optind + 1]);
+        exit(-1);
+    }
+
+    workers = xmalloc(job.n_threads * sizeof(struct WCCWorker), "threads");
+    for (idx = 0; idx < (unsigned long) job.n_threads; ++idx) {
+        workers[idx].id = idx;
+        workers[idx].job = &job;
+    }
+
+    /* split the input into one line aligned chunk per thread and count its edges */
+    t0 = now_s();
+    job.chunk_start = xmalloc((job.n_threads + 1) * sizeof(size_t), "chunks");
+    job.chunk_base = calloc(job.n_threads + 1, sizeof(uint64_t));
+    if (!job.chunk_base) {
+        printf("FATAL: Unable to allocate chunks\n");
+        exit(-1);
+    }
+    job.chunk_start[0] = 0;
+    for (idx = 1; idx <= (unsigned long) job.n_threads; ++idx) {
+        size_t pos = job.size * idx / job.n_threads;
+        const char *nl;
+
+        if (pos < job.chunk_start[idx - 1]) pos = job.chunk_start[idx - 1];
+        nl = (pos > 0 && pos < job.size) ? memchr(job.map + pos - 1, '\n', job.size - pos + 1) : NULL;
+        job.chunk_start[idx] = (idx == (unsigned long) job.n_threads || !nl) ? job.size : (size_t)(nl - job.map) + 1;
+    }
+    run_workers(&job, workers, count_worker);
+    for (idx = 1; idx <= (unsigned long) job.n_threads; ++idx) {
+        job.chunk_base[idx] += job.chunk_base[idx - 1];
+    }
+    job.n_edges = job.chunk_base[job.n_threads];
+
+    /*
+     * Size the passes: every thread sorts one partition at a time, and
+     * every thread loads one bucket next to the shared union-find.
+     */
+    per_thread = job.budget / 2 / job.n_threads;
+    job.n_parts = (2 * job.n_edges * sizeof(struct EndpointRec)) / per_thread + 1;
+    job.bucket_edges = per_thread / 2 / (2 * sizeof(uint64_t));
+    if (job.bucket_edges < 1) job.bucket_edges = 1;
+    job.n_buckets = job.n_edges / job.bucket_edges + 1;
+    job.buf_recs = job.budget / 4 / job.n_threads / (job.n_parts + job.n_buckets) / sizeof(struct EndpointRec);
+    if (job.buf_recs < 16) job.buf_recs = 16;
+    if (job.buf_recs > 4096) job.buf_recs = 4096;
+
+    job.parts = xmalloc(job.n_parts * sizeof(struct SpillFile), "partitions");
+    for (idx = 0; idx < job.n_parts; ++idx) {
+        spill_open(&job.parts[idx], job.tmp_dir, 'p', idx, "wb");
+    }
+    run_workers(&job, workers, partition_worker);
+    for (idx = 0; idx < job.n_parts; ++idx) {
+        fclose(job.parts[idx].fp);
+        pthread_mutex_destroy(&job.parts[idx].lock);
+    }
+    printf("Pass 1: %.3f s, %lu edges into %lu partitions\n", now_s() - t0, (unsigned long) job.n_edges, job.n_parts);
+
+    /* pass 2 */
+    t0 = now_s();
+    job.buckets = xmalloc(job.n_buckets * sizeof(struct SpillFile), "buckets");
+    for (idx = 0; idx < job.n_buckets; ++idx) {
+        spill_open(&job.buckets[idx], job.tmp_dir, 'b', idx, "wb");
+    }
+    job.part_base = calloc(job.n_parts + 1, sizeof(uint64_t));
+    if (!job.part_base) {
+        printf("FATAL: Unable to allocate partitions\n");
+        exit(-1);
+    }
+    atomic_store(&job.next, 0);
+    run_workers(&job, workers, number_worker);
+    for (idx = 0; idx < job.n_buckets; ++idx) {
+        fclose(job.buckets[idx].fp);
+        pthread_mutex_destroy(&job.buckets[idx].lock);
+    }
+    for (idx = 1; idx <= job.n_parts; ++idx) {
+        job.part_base[idx] += job.part_base[idx - 1];
+    }
+    job.n_nodes = job.part_base[job.n_parts];
+    printf("Pass 2: %.3f s, %lu spike pairs, %lu buckets\n", now_s() - t0, (unsigned long) job.n_nodes, job.n_buckets);
+
+    /* the buckets loaded in pass 3 take a quarter of the budget */
+    if (job.n_nodes * sizeof(uint64_t) > job.budget - job.budget / 4) {
+        printf("FATAL: %lu spike pairs need %lu MB for the union-find, more than the budget leaves\n",
+               (unsigned long) job.n_nodes, (unsigned long)((job.n_nodes * sizeof(uint64_t)) >> 20) + 1);
+        spill_remove(job.tmp_dir, 'b', job.n_buckets);
+        spill_remove(job.tmp_dir, 'k', job.n_parts);
+        exit(-1);
+    }
+
+    /* pass 3 */
+    t0 = now_s();
+    job.parent = xmalloc(job.n_nodes * sizeof(uint64_t), "union-find");
+    for (idx = 0; idx < job.n_nodes; ++idx) {
+        atomic_init(&job.parent[idx], idx);
+    }
+    atomic_store(&job.next, 0);
+    run_workers(&job, workers, union_worker);
+    run_workers(&job, workers, compress_worker);
+    printf("Pass 3: %.3f s\n", now_s() - t0);
+
+    /* pass 4 */
+    t0 = now_s();
+    n_comp = write_labels(&job, out);
+    printf("Pass 4: %.3f s, %lu components\n", now_s() - t0, (unsigned long) n_comp);
+
+    fclose(out);
+    if (job.size) munmap((void *) job.map, job.size);
+    close(fd);
+    free((void *) job.parent);
+    free(job.part_base);
+    free(job.parts);
+    free(job.buckets);
+    free(job.chunk_start);
+    free(job.chunk_base);
+    free(workers);
+    return 0;
+}
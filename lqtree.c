@@ -0,0 +1,285 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Linear quadtree routines
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "quadtree.h"
+#include "lqtree.h"
+#include "memstat.h"
+
+/* spike pair tagged with its Morton code, only used while building */
+struct MortonPair {
+
+    uint64_t code;
+    uint32_t t1;
+    uint32_t t2;
+};
+
+/*
+ * Spreads the bits of v so that bit i moves to bit 2i
+ */
+static uint64_t spread_bits(uint32_t v) {
+
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2))  & 0x3333333333333333ULL;
+    x = (x | (x << 1))  & 0x5555555555555555ULL;
+    return x;
+}
+
+/*
+ * Z-order code of the point (x, y): x in the even bits, y in the odd bits.
+ * At every level the two bits select the quadrant as x_bit | (y_bit << 1).
+ */
+static uint64_t morton_code(uint32_t x, uint32_t y) {
+
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+static int morton_cmp(const void *a, const void *b) {
+
+    const struct MortonPair *pa = a;
+    const struct MortonPair *pb = b;
+
+    if (pa->code < pb->code) return -1;
+    if (pa->code > pb->code) return 1;
+    return 0;
+}
+
+/*
+ * Smallest power of two exponent whose square covers [t_min, t_max]
+ */
+unsigned int LQTreeRootLog2Size(long t_min, long t_max) {
+
+    unsigned int log2_size = 0;
+    unsigned long span = (unsigned long)(t_max - t_min) + 1;
+
+    while (log2_size < LQT_MAX_LOG2_SIZE && (1UL << log2_size) < span) {
+        log2_size++;
+    }
+    if ((1UL << log2_size) < span) {
+        printf("FATAL: Recording too long for linear quadtree (span %lu)\n", span);
+        exit(-1);
+    }
+    return log2_size;
+}
+
+/*
+ * Whether spike times in [t_min, t_max] fit the 32 bit offsets of a tree
+ */
+int LQTreeSpanFits(long t_min, long t_max) {
+
+    return (unsigned long)(t_max - t_min) < (1UL << LQT_MAX_LOG2_SIZE);
+}
+
+/*
+ * Reserves n consecutive entries in the node table, returns the index of the first
+ */
+static uint32_t LQTreeAllocNodes(struct LQTree *lqt, unsigned long *cap, unsigned int n) {
+
+    uint32_t res;
+
+    if (lqt->n_nodes + n > *cap) {
+        *cap = 2 * (*cap) + 4 * n;
+        lqt->nodes = realloc(lqt->nodes, (*cap) * sizeof(struct LQTreeNode));
+        if (!lqt->nodes) {
+            MemFatal("linear quadtree nodes");
+        }
+    }
+    res = lqt->n_nodes;
+    lqt->n_nodes += n;
+    return res;
+}
+
+/*
+ * First index in [lo, hi) whose quadrant bits at shift are at least q.
+ * All codes in the range share their higher bits, so the quadrant bits are sorted.
+ */
+static unsigned long quadrant_bound(struct MortonPair *mp, unsigned long lo, unsigned long hi, unsigned int shift, unsigned int q) {
+
+    unsigned long mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (((mp[mid].code >> shift) & 3) < q) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void LQTreeBuildNode(struct LQTree *lqt, unsigned long *cap, struct MortonPair *mp,
+                            uint32_t node, unsigned long lo, unsigned long hi, unsigned int level) {
+
+    unsigned long bounds[5];
+    unsigned int q, shift;
+    uint32_t child;
+
+    lqt->nodes[node].first = lo;
+    lqt->nodes[node].count = hi - lo;
+    lqt->nodes[node].child = 0;
+
+    if ((hi - lo) <= LQT_LEAF_CAP || level == 0) return;
+
+    child = LQTreeAllocNodes(lqt, cap, 4);
+    lqt->nodes[node].child = child;
+
+    /* split the range at the quadrant boundaries */
+    shift = 2 * (level - 1);
+    bounds[0] = lo;
+    for (q = 1; q < 4; ++q) {
+        bounds[q] = quadrant_bound(mp, bounds[q-1], hi, shift, q);
+    }
+    bounds[4] = hi;
+
+    for (q = 0; q < 4; ++q) {
+        LQTreeBuildNode(lqt, cap, mp, child + q, bounds[q], bounds[q+1], level - 1);
+    }
+}
+
+/*
+ * Builds the linear quadtree holding all spike pairs of the time sorted
+ * spike list list_head.  The root square has its lower left corner at
+ * (t0, t0) and side 2^log2_size.
+ */
+struct LQTree *LQTreeBuild(uint32_t n_id, struct Spike *list_head, long t0, unsigned int log2_size) {
+
+    struct LQTree *res;
+    struct MortonPair *mp;
+    struct Spike *sp_a, *sp_b;
+    unsigned long n_spikes, n_pairs, idx, cap;
+
+    res = malloc(sizeof(struct LQTree));
+    if (!res) {
+        MemFatal("linear quadtree");
+    }
+    res->n_id = n_id;
+    res->t0 = t0;
+    res->log2_size = log2_size;
+    res->n_nodes = 0;
+    res->nodes = (struct LQTreeNode *) NULL;
+
+    /* upper bound on the number of pairs */
+    n_spikes = 0;
+    for (sp_a = list_head; sp_a; sp_a = sp_a->next) n_spikes++;
+
+    mp = malloc((n_spikes * (n_spikes - 1) / 2 + 1) * sizeof(struct MortonPair));
+    if (!mp) {
+        MemFatal("spike pairs for linear quadtree");
+    }
+    MemAlloc(MEM_LQTREE, (n_spikes * (n_spikes - 1) / 2 + 1) * sizeof(struct MortonPair));
+
+    n_pairs = 0;
+    for (sp_a = list_head; sp_a; sp_a = sp_a->next) {
+        for (sp_b = sp_a->next; sp_b; sp_b = sp_b->next) {
+            if (spike_equals(sp_a, sp_b)) continue;
+            mp[n_pairs].t1 = sp_a->ts - t0;
+            mp[n_pairs].t2 = sp_b->ts - t0;
+            mp[n_pairs].code = morton_code(mp[n_pairs].t1, mp[n_pairs].t2);
+            n_pairs++;
+        }
+    }
+    qsort(mp, n_pairs, sizeof(struct MortonPair), morton_cmp);
+
+    /* node table */
+    cap = 0;
+    LQTreeAllocNodes(res, &cap, 1);
+    LQTreeBuildNode(res, &cap, mp, 0, 0, n_pairs, log2_size);
+    res->nodes = realloc(res->nodes, res->n_nodes * sizeof(struct LQTreeNode));
+
+    /* split into structure of arrays */
+    res->n_pairs = n_pairs;
+    res->t1 = malloc((n_pairs + 1) * sizeof(uint32_t));
+    res->t2 = malloc((n_pairs + 1) * sizeof(uint32_t));
+    if (!res->t1 || !res->t2) {
+        MemFatal("linear quadtree pairs");
+    }
+    MemAlloc(MEM_LQTREE, LQTreeMemory(res));
+    for (idx = 0; idx < n_pairs; ++idx) {
+        res->t1[idx] = mp[idx].t1;
+        res->t2[idx] = mp[idx].t2;
+    }
+
+    MemFree(MEM_LQTREE, (n_spikes * (n_spikes - 1) / 2 + 1) * sizeof(struct MortonPair));
+    free(mp);
+    return res;
+}
+
+void LQTreeDestroy(struct LQTree *lqt) {
+
+    if (!lqt) return;
+
+    MemFree(MEM_LQTREE, LQTreeMemory(lqt));
+    free(lqt->t1);
+    free(lqt->t2);
+    free(lqt->nodes);
+    free(lqt);
+}
+
+/*
+ * Bytes used by the tree, not counting allocator overhead
+ */
+unsigned long LQTreeMemory(struct LQTree *lqt) {
+
+    return sizeof(struct LQTree)
+         + lqt->n_nodes * sizeof(struct LQTreeNode)
+         + 2 * lqt->n_pairs * sizeof(uint32_t);
+}
+
+/*
+ * Bytes that n_trees trees over n_pairs pairs in all are expected to
+ * take, plus the sort buffer of the largest tree, with max_pairs pairs,
+ * while it is built.  Leaves are assumed to be a quarter full.
+ */
+unsigned long LQTreeEstimateMemory(unsigned long n_trees, unsigned long n_pairs, unsigned long max_pairs) {
+
+    unsigned long n_nodes = 4 * n_pairs / LQT_LEAF_CAP + n_trees;
+
+    return n_trees * sizeof(struct LQTree)
+         + n_nodes * sizeof(struct LQTreeNode)
+         + 2 * n_pairs * sizeof(uint32_t)
+         + max_pairs * sizeof(struct MortonPair);
+}
+
+void LQTreePrint(struct LQTree *lqt) {
+
+    unsigned long idx;
+
+    if (!lqt) return;
+
+    for (idx = 0; idx < lqt->n_pairs; ++idx) {
+        printf("Spike[%d, %ld] <---> Spike[%d, %ld]\n", lqt->n_id, lqt->t0 + lqt->t1[idx], lqt->n_id, lqt->t0 + lqt->t2[idx]);
+    }
+}
@@ -0,0 +1,82 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef LQTREE_H
+#define LQTREE_H
+
+#include <stdint.h>
+
+#include "quadtree.h"
+
+#define LQT_LEAF_CAP 16 /* maximum number of pairs in a leaf */
+
+/*
+ * Pointer-free linear quadtree
+ *
+ * All spike pairs of a neuron are stored in one pair of arrays sorted
+ * by the Morton (Z-order) code of (t1, t2).  Every node covers a
+ * contiguous range of those arrays.  The four children of a node are
+ * stored next to each other in the node table, so a node only needs the
+ * index of its first child.  Node bounds are not stored: they follow
+ * from the root square and the path taken from the root.
+ * Spike times are stored as 32 bit offsets from the root corner t0,
+ * which halves the pair storage and lets the batch test in gnatbatch.c
+ * work on 8 or 16 pairs per instruction, and limit a recording to
+ * 2^LQT_MAX_LOG2_SIZE ticks.
+ */
+
+#define LQT_MAX_LOG2_SIZE 32
+
+struct LQTreeNode {
+
+    unsigned long first; /* index of the node's first pair */
+    uint32_t count;      /* number of pairs under the node */
+    uint32_t child;      /* index of the first of four children, 0 for a leaf */
+};
+
+struct LQTree {
+
+    uint32_t n_id;          /* neuron id */
+    unsigned long n_pairs;
+    uint32_t *t1;           /* earlier spike time of each pair minus t0, Morton order */
+    uint32_t *t2;           /* later spike time of each pair minus t0, Morton order */
+
+    unsigned long n_nodes;
+    struct LQTreeNode *nodes;
+
+    long t0;                /* lower left corner of the root square */
+    unsigned int log2_size; /* root square has side 2^log2_size */
+};
+
+struct LQTree *LQTreeBuild(uint32_t n_id, struct Spike *list_head, long t0, unsigned int log2_size);
+void           LQTreeDestroy(struct LQTree *lqt);
+unsigned long  LQTreeMemory(struct LQTree *lqt);
+unsigned long  LQTreeEstimateMemory(unsigned long n_trees, unsigned long n_pairs, unsigned long max_pairs);
+void           LQTreePrint(struct LQTree *lqt);
+unsigned int   LQTreeRootLog2Size(long t_min, long t_max);
+int            LQTreeSpanFits(long t_min, long t_max);
+
+#endif
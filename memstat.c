@@ -0,0 +1,284 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+
+#include "memstat.h"
+
+static const char *mem_names[N_MEM_CATEGORIES] = {"spike", "spike_pair", "qtree_node", "bbox", "lqtree", "synapse", "edge_buffer"};
+
+static _Atomic uint64_t g_bytes[N_MEM_CATEGORIES], g_peak[N_MEM_CATEGORIES];
+static _Atomic uint64_t g_total, g_total_peak;
+
+/* largest RSS watermark seen by MemSampleRSS, in kB */
+static long g_rss_peak;
+
+static void atomic_max(_Atomic uint64_t *m, uint64_t v) {
+
+    uint64_t cur = atomic_load_explicit(m, memory_order_relaxed);
+
+    while (v > cur && !atomic_compare_exchange_weak_explicit(m, &cur, v, memory_order_relaxed, memory_order_relaxed));
+}
+
+void MemAlloc(enum MemCategory cat, size_t bytes) {
+
+    uint64_t v;
+
+    v = atomic_fetch_add_explicit(&g_bytes[cat], bytes, memory_order_relaxed) + bytes;
+    atomic_max(&g_peak[cat], v);
+    v = atomic_fetch_add_explicit(&g_total, bytes, memory_order_relaxed) + bytes;
+    atomic_max(&g_total_peak, v);
+}
+
+void MemFree(enum MemCategory cat, size_t bytes) {
+
+    atomic_fetch_sub_explicit(&g_bytes[cat], bytes, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&g_total, bytes, memory_order_relaxed);
+}
+
+uint64_t MemBytes(enum MemCategory cat) {
+
+    return atomic_load_explicit(&g_bytes[cat], memory_order_relaxed);
+}
+
+uint64_t MemPeak(enum MemCategory cat) {
+
+    return atomic_load_explicit(&g_peak[cat], memory_order_relaxed);
+}
+
+const char *MemCategoryName(enum MemCategory cat) {
+
+    return mem_names[cat];
+}
+
+/*
+ * Prints the bytes held and the peak of each category, and the peak RSS
+ */
+void MemReport(void) {
+
+    int idx;
+
+    printf("%-14s %16s %16s\n", "memory", "bytes", "peak bytes");
+    for (idx = 0; idx < N_MEM_CATEGORIES; ++idx) {
+        printf("%-14s %16llu %16llu\n", mem_names[idx], (unsigned long long)MemBytes(idx),
+               (unsigned long long)MemPeak(idx));
+    }
+    printf("%-14s %16llu %16llu\n", "total", (unsigned long long)atomic_load(&g_total),
+           (unsigned long long)atomic_load(&g_total_peak));
+    printf("%-14s %16ld %16ld\n", "RSS kB", MemCurrentRSS(), MemPeakRSS());
+}
+
+/*
+ * Reports a failed allocation of what with the memory held so far, and
+ * exits
+ */
+void MemFatal(const char *what) {
+
+    printf("FATAL: Unable to allocate %s\n", what);
+    MemReport();
+    exit(-1);
+}
+
+/* value of field (such as "VmRSS:") in /proc/self/status in kB, or -1 */
+static long proc_status_kb(const char *field) {
+
+    FILE *fp;
+    char line[256];
+    size_t len = strlen(field);
+    long res = -1;
+
+    fp = fopen("/proc/self/status", "r");
+    if (!fp) return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, field, len)) {
+            res = atol(line + len);
+            break;
+        }
+    }
+    fclose(fp);
+    return res;
+}
+
+/* resident set size in kB */
+long MemCurrentRSS(void) {
+
+    return proc_status_kb("VmRSS:");
+}
+
+/*
+ * Returns the RSS watermark in kB and, where the kernel allows it, resets
+ * the watermark to the current RSS, so that the next sample gives the
+ * peak since this one.  Otherwise every sample gives the process peak.
+ */
+long MemSampleRSS(void) {
+
+    struct rusage ru;
+    FILE *fp;
+    long res;
+
+    res = proc_status_kb("VmHWM:");
+    if (res < 0) {
+        getrusage(RUSAGE_SELF, &ru);
+        res = ru.ru_maxrss;
+    }
+    if (res > g_rss_peak) g_rss_peak = res;
+
+    fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+    return res;
+}
+
+/* peak RSS of the process in kB */
+long MemPeakRSS(void) {
+
+    long res = proc_status_kb("VmHWM:");
+
+    return (res > g_rss_peak) ? res : g_rss_peak;
+}
+
+/* reads one number from fname, -1 if there is none (such as "max") */
+static long long read_limit(const char *fname) {
+
+    FILE *fp;
+    long long res = -1;
+
+    fp = fopen(fname, "r");
+    if (!fp) return -1;
+    if (fscanf(fp, "%lld", &res) != 1) res = -1;
+    fclose(fp);
+    return res;
+}
+
+/* cgroup v1 reports no limit as a number just under 2^63 */
+#define CGROUP_NO_LIMIT (1LL << 62)
+
+/*
+ * Least room left under the memory limits of cgroup path, relative to
+ * the hierarchy mounted at root, and of its ancestors.  Levels whose
+ * files are missing, as when path lies outside the mounted hierarchy,
+ * are skipped.  -1 if no level sets a limit.
+ */
+static long long cgroup_headroom(const char *root, const char *path, const char *max_file, const char *cur_file) {
+
+    char dir[PATH_MAX], fname[PATH_MAX + 32];
+    size_t root_len = strlen(root), len;
+    long long res = -1, lim, cur;
+
+    snprintf(dir, sizeof(dir), "%s%s", root, path);
+    for (;;) {
+        len = strlen(dir);
+        while (len > root_len && dir[len - 1] == '/') dir[--len] = '\0';
+
+        snprintf(fname, sizeof(fname), "%s/%s", dir, max_file);
+        lim = read_limit(fname);
+        snprintf(fname, sizeof(fname), "%s/%s", dir, cur_file);
+        cur = read_limit(fname);
+        if (lim >= 0 && lim < CGROUP_NO_LIMIT && cur >= 0) {
+            lim = (lim > cur) ? lim - cur : 0;
+            if (res < 0 || lim < res) res = lim;
+        }
+
+        if (len <= root_len || !strrchr(dir + root_len, '/')) break;
+        *strrchr(dir + root_len, '/') = '\0';
+    }
+    return res;
+}
+
+/*
+ * Room left in the cgroups of the process, from the cgroup v2 entry
+ * (0::<path>) or the v1 memory controller entry of /proc/self/cgroup.
+ * -1 if no limit is set.
+ */
+static long long cgroups_headroom(void) {
+
+    FILE *fp;
+    char line[PATH_MAX + 64], *ctrl, *path;
+    long long res = -1, lim;
+
+    fp = fopen("/proc/self/cgroup", "r");
+    if (!fp) return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        ctrl = strchr(line, ':');
+        if (!ctrl) continue;
+        path = strchr(++ctrl, ':');
+        if (!path) continue;
+        *path++ = '\0';
+
+        if (!strcmp(line, "0:") && !*ctrl) {
+            lim = cgroup_headroom("/sys/fs/cgroup", path, "memory.max", "memory.current");
+        } else if (strstr(ctrl, "memory")) {
+            lim = cgroup_headroom("/sys/fs/cgroup/memory", path, "memory.limit_in_bytes", "memory.usage_in_bytes");
+        } else {
+            continue;
+        }
+        if (lim >= 0 && (res < 0 || lim < res)) res = lim;
+    }
+    fclose(fp);
+    return res;
+}
+
+/*
+ * Bytes the process can still grow by: the least of the system's
+ * available memory, the room left in its cgroup and the room left under
+ * its address space limit.  -1 if none of them is known.
+ */
+long long MemHeadroom(void) {
+
+    FILE *fp;
+    char line[256];
+    struct rlimit rl;
+    long long res = -1, lim;
+    long kb;
+
+    fp = fopen("/proc/meminfo", "r");
+    if (fp) {
+        while (fgets(line, sizeof(line), fp)) {
+            if (!strncmp(line, "MemAvailable:", 13)) {
+                res = 1024LL * atol(line + 13);
+                break;
+            }
+        }
+        fclose(fp);
+    }
+
+    lim = cgroups_headroom();
+    if (lim >= 0 && (res < 0 || lim < res)) res = lim;
+
+    kb = proc_status_kb("VmSize:");
+    if (kb >= 0 && !getrlimit(RLIMIT_AS, &rl) && rl.rlim_cur != RLIM_INFINITY) {
+        lim = ((long long)rl.rlim_cur > 1024LL * kb) ? (long long)rl.rlim_cur - 1024LL * kb : 0;
+        if (res < 0 || lim < res) res = lim;
+    }
+    return res;
+}
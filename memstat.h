@@ -0,0 +1,74 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Accounting of the bytes held by each kind of structure, and samples of
+ * the resident set size.
+ *
+ * Allocation sites report with MemAlloc / MemFree; objects that are made
+ * in bulk, such as the spikes of a parse chunk, are reported once per
+ * batch.  Memory mapped caches are not counted.  The counts are printed
+ * with the phase table and by MemFatal when an allocation fails.
+ */
+
+enum MemCategory {
+    MEM_SPIKE,       /* Spike structs and the flat spike time arrays */
+    MEM_SPIKE_PAIR,
+    MEM_QTREE_NODE,
+    MEM_BBOX,
+    MEM_LQTREE,      /* linear quadtree nodes and pairs */
+    MEM_SYNAPSE,     /* the network arrays and their parse buffers */
+    MEM_EDGE_BUFFER,
+    N_MEM_CATEGORIES
+};
+
+void MemAlloc(enum MemCategory cat, size_t bytes);
+void MemFree(enum MemCategory cat, size_t bytes);
+uint64_t MemBytes(enum MemCategory cat);
+uint64_t MemPeak(enum MemCategory cat);
+const char *MemCategoryName(enum MemCategory cat);
+void MemReport(void);
+void MemFatal(const char *what);
+
+long MemCurrentRSS(void);
+long MemSampleRSS(void);
+long MemPeakRSS(void);
+long long MemHeadroom(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
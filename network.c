@@ -28,10 +28,16 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "network.h"
+#include "spikefile.h"
+#include "gnatcache.h"
+#include "trace.h"
+#include "memstat.h"
 
-#define SYN_LINE_MAX 512
+#define SYN_FIELD_MAX 64
 
 /*
  * Network implementation for GNATFinder
@@ -40,116 +46,475 @@
  */
 
 /*
- * Initialize a PhysNetwork structure by allocating memory for the 
- * synapse lists.
+ * Initialize a PhysNetwork structure with no synapses.
  */
 int PhysNetworkInit(struct PhysNetwork *pn, unsigned long _n_cells) {
 
     pn->n_cells = _n_cells;
-    pn->presyns = malloc(_n_cells * sizeof(struct Synapse *));
-    if (!pn->presyns) {
-        printf("FATAL: Unable to allocate space for synapse lists\n");
-        exit(-1);
+    pn->n_syns = 0;
+    pn->offsets = calloc(_n_cells + 1, sizeof(unsigned long));
+    if (!pn->offsets) {
+        MemFatal("space for synapse offsets");
     }
+    MemAlloc(MEM_SYNAPSE, (_n_cells + 1) * sizeof(unsigned long));
+    pn->src_id = NULL;
+    pn->delay = NULL;
+    pn->neg_log_rel_w = NULL;
+    pn->rel_w = NULL;
+    pn->win_lo = NULL;
+    pn->win_hi = NULL;
+    pn->text_rel_w = NULL;
+    pn->text_delay = NULL;
+    pn->cache = NULL;
     return 0;
 
 }
 
-void PhysNetworkAddSynapse(struct PhysNetwork *pn, struct Synapse *edg) {
+/* bytes of the per-synapse values for n synapses */
+static size_t network_value_bytes(unsigned long n) {
 
-    if (edg->tgt_id >= pn->n_cells) {
-        printf("FATAL: Trying to add synapse onto a cell outside of the network population.\n");
-        exit(-1);
+    return n * (sizeof(uint32_t) + 3 * sizeof(float));
+}
+
+/* bytes of the causal windows of n synapses */
+static size_t network_window_bytes(unsigned long n) {
+
+    return n * 2 * sizeof(int32_t);
+}
+
+/*
+ * Allocates the causal windows of pn->n_syns synapses.
+ */
+static void network_alloc_windows(struct PhysNetwork *pn) {
+
+    unsigned long n = pn->n_syns + 1;
+    char what[64];
+
+    pn->win_lo = malloc(n * sizeof(int32_t));
+    pn->win_hi = malloc(n * sizeof(int32_t));
+    if (!pn->win_lo || !pn->win_hi) {
+        snprintf(what, sizeof(what), "windows of %lu synapses", pn->n_syns);
+        MemFatal(what);
+    }
+    MemAlloc(MEM_SYNAPSE, network_window_bytes(n));
+}
+
+/*
+ * Allocates the per-synapse arrays for pn->n_syns synapses, and with
+ * keep_text the arrays of their weights and delays as parsed.
+ */
+static void network_alloc_synapses(struct PhysNetwork *pn, int keep_text) {
+
+    unsigned long n = pn->n_syns + 1;
+    char what[64];
+
+    pn->src_id = malloc(n * sizeof(uint32_t));
+    pn->delay = malloc(n * sizeof(float));
+    pn->neg_log_rel_w = malloc(n * sizeof(float));
+    pn->rel_w = malloc(n * sizeof(float));
+    if (!pn->src_id || !pn->delay || !pn->neg_log_rel_w || !pn->rel_w) {
+        snprintf(what, sizeof(what), "space for %lu synapses", pn->n_syns);
+        MemFatal(what);
+    }
+    MemAlloc(MEM_SYNAPSE, network_value_bytes(n));
+    network_alloc_windows(pn);
+
+    if (keep_text) {
+        pn->text_rel_w = malloc(n * sizeof(double));
+        pn->text_delay = malloc(n * sizeof(double));
+        if (!pn->text_rel_w || !pn->text_delay) {
+            snprintf(what, sizeof(what), "parsed values of %lu synapses", pn->n_syns);
+            MemFatal(what);
+        }
+        MemAlloc(MEM_SYNAPSE, 2 * n * sizeof(double));
     }
+}
 
-    if (!pn->presyns[edg->tgt_id]) {
-        pn->presyns[edg->tgt_id] = edg;
+/* drops the weights and delays kept as parsed */
+static void network_free_text(struct PhysNetwork *pn) {
+
+    if (pn->text_rel_w) MemFree(MEM_SYNAPSE, 2 * (pn->n_syns + 1) * sizeof(double));
+    free(pn->text_rel_w);
+    free(pn->text_delay);
+    pn->text_rel_w = pn->text_delay = NULL;
+}
+
+/*
+ * Stores synapse idx of pn.  Its window is empty until
+ * GNAT_compute_windows is called.
+ */
+static void network_set_synapse(struct PhysNetwork *pn, unsigned long idx, unsigned long _src, float _rel_w, float delay) {
+
+    pn->src_id[idx] = _src;
+    pn->rel_w[idx] = _rel_w;
+    pn->neg_log_rel_w[idx] = -1*log(_rel_w);
+    pn->delay[idx] = delay;
+    pn->win_lo[idx] = 0;
+    pn->win_hi[idx] = -1;
+}
+
+void PhysNetworkFree(struct PhysNetwork *pn) {
+
+    if (pn->cache) {
+        NetworkCacheUnmap(pn->cache);
+        free(pn->cache);
+        pn->cache = NULL;
     } else {
-        edg->next = pn->presyns[edg->tgt_id];
-        pn->presyns[edg->tgt_id] = edg;
+        if (pn->offsets) MemFree(MEM_SYNAPSE, (pn->n_cells + 1) * sizeof(unsigned long));
+        if (pn->src_id) MemFree(MEM_SYNAPSE, network_value_bytes(pn->n_syns + 1));
+        free(pn->offsets);
+        free(pn->src_id);
+        free(pn->delay);
+        free(pn->neg_log_rel_w);
+        free(pn->rel_w);
     }
+    if (pn->win_lo) MemFree(MEM_SYNAPSE, network_window_bytes(pn->n_syns + 1));
+    free(pn->win_lo);
+    free(pn->win_hi);
+    network_free_text(pn);
+    pn->offsets = NULL;
+    pn->src_id = NULL;
+    pn->delay = pn->neg_log_rel_w = pn->rel_w = NULL;
+    pn->win_lo = pn->win_hi = NULL;
 }
 
-struct Synapse *SynapseCreate(unsigned long _src, unsigned long _tgt, float _rel_w, float delay) {
+/*
+ * Copies synapse idx, which ends on cell tgt_id, out of pn.
+ */
+void SynapseGet(const struct PhysNetwork *pn, unsigned long tgt_id, unsigned long idx, struct Synapse *syn) {
+
+    syn->idx = idx;
+    syn->src_id = pn->src_id[idx];
+    syn->tgt_id = tgt_id;
+    syn->rel_w = pn->rel_w[idx];
+    syn->neg_log_rel_w = pn->neg_log_rel_w[idx];
+    syn->delay = pn->delay[idx];
+    syn->win_lo = pn->win_lo[idx];
+    syn->win_hi = pn->win_hi[idx];
+}
 
-    float _nl_rel_w;
+/*
+ * Copies the blank separated field at *pos on the line ending at eol into
+ * buf, NUL terminated, and advances *pos past it.  Returns 0 if the line
+ * has no further field.
+ */
+static int next_field(const char **pos, const char *eol, char *buf) {
 
-    struct Synapse *res = malloc(sizeof(struct Synapse));
-    if (!res) {
-        printf("FATAL: Cannot allocate synapse\n");
-        exit(-1);
+    const char *p = *pos;
+    size_t len = 0;
+
+    while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    while (p < eol && *p != ' ' && *p != '\t' && *p != '\r' && len < SYN_FIELD_MAX - 1) {
+        buf[len++] = *p++;
     }
+    buf[len] = '\0';
+    *pos = p;
+    return len > 0;
+}
 
-    res->src_id = _src;
-    res->tgt_id = _tgt;
-    res->rel_w = _rel_w;
-    res->delay = delay;
-    res->next = (struct Synapse *)NULL;
+/* synapse as parsed from one line, before it is placed */
+struct SynapseLine {
 
-    _nl_rel_w = -1*log(_rel_w);
-    res->neg_log_rel_w = _nl_rel_w;
+    uint32_t src_id;
+    uint32_t tgt_id;
+    float rel_w;
+    float delay;
+};
 
-    return res;
+/*
+ * One newline aligned piece of the network file, parsed by its own thread.
+ * The chunk's synapses onto each target are later placed, in file order,
+ * after those of the earlier chunks.
+ */
+struct NetworkChunk {
+
+    pthread_t thread;
+    struct PhysNetwork *pn;
+    const char *begin;
+    const char *end;
+
+    struct SynapseLine *lines;
+    double *text; /* weight and delay of each line as parsed, with keep_text */
+    int keep_text;
+    unsigned long n, cap;
+    unsigned long *count; /* synapses per target, then the target's next slot */
+};
+
+/* bytes a chunk holds per synapse line */
+static size_t network_line_bytes(int keep_text) {
+
+    return sizeof(struct SynapseLine) + (keep_text ? 2 * sizeof(double) : 0);
 }
 
-void PhysNetworkReadFile(struct PhysNetwork *pn, char *fname) {
+/*
+ * Parses the synapse on the line [*pos, eol).  Returns 0 for a blank line.
+ * Weights and delays are parsed as double, as gnat1 and the network cache
+ * hold them, and narrowed to float by the caller.
+ */
+static int parse_synapse(const char *p, const char *eol, unsigned long *src_id, unsigned long *tgt_id, double *rel_w, double *delay) {
 
-    /* 
-     * File format:
-     * <src_id> <tgt_id> <rel_w> <delay>
-     */
+    char field[SYN_FIELD_MAX], *end;
 
-    /* Attempt to open file */
-    FILE *syn_file;
-    syn_file = fopen(fname, "r");
-    if (!syn_file) {
-        printf("FATAL: Unable to open synapse file %s\n", fname);
+    /* skip blank lines */
+    if (!next_field(&p, eol, field)) return 0;
+    *src_id = strtol(field, &end, 0);
+    if (end == field) {
+        printf("FATAL: Unable to parse source neuron\n");
+        exit(-1);
+    }
+
+    next_field(&p, eol, field);
+    *tgt_id = strtol(field, &end, 0);
+    if (end == field) {
+        printf("FATAL: Unable to parse target neuron\n");
         exit(-1);
     }
 
-    /* for each line create a synapse */
-    char line[SYN_LINE_MAX];
-    char *field, *end;
+    next_field(&p, eol, field);
+    *rel_w = strtod(field, &end);
+    if (end == field) {
+        printf("FATAL: Unable to parse relative weight\n");
+        exit(-1);
+    }
+
+    next_field(&p, eol, field);
+    *delay = strtod(field, &end);
+    if (end == field) {
+        printf("FATAL: Unable to parse delay\n");
+        exit(-1);
+    }
+    return 1;
+}
+
+static void *network_chunk_read(void *arg) {
+
+    struct NetworkChunk *c = (struct NetworkChunk *)arg;
+    const char *p, *eol;
 
     unsigned long src_id, tgt_id;
-    float rel_w, delay;
+    double rel_w, delay;
 
-    struct Synapse *syn;
+    TRACE_THREAD_NAME("network reader", -1);
+    TRACE_BEGIN("network chunk");
+    for (p = c->begin; p < c->end; p = (eol < c->end) ? eol + 1 : eol) {
+        eol = SpikeFindNewline(p, c->end);
+        if (!parse_synapse(p, eol, &src_id, &tgt_id, &rel_w, &delay)) continue;
 
-    while (fgets(line, SYN_LINE_MAX, syn_file)) {
-        field = strtok(line, " ");
-        src_id = strtol(field, &end, 0);
-        if (end == field) {
-            printf("FATAL: Unable to parse source neuron\n");
+        if (tgt_id >= c->pn->n_cells) {
+            printf("FATAL: Trying to add synapse onto a cell outside of the network population.\n");
             exit(-1);
         }
-
-        field = strtok(NULL, " ");
-        tgt_id = strtol(field, &end, 0);
-        if (end == field) {
-            printf("FATAL: Unable to parse target neuron\n");
+        if (src_id >= c->pn->n_cells) {
+            printf("FATAL: Trying to add synapse from a cell outside of the network population.\n");
             exit(-1);
         }
 
-        field = strtok(NULL, " ");
-        rel_w = strtof(field, &end);
-        if (end == field) {
-            printf("FATAL: Unable to parse relative weight\n");
+        if (c->n == c->cap) {
+            MemAlloc(MEM_SYNAPSE, (c->cap ? c->cap : 4096) * network_line_bytes(c->keep_text));
+            c->cap = c->cap ? 2 * c->cap : 4096;
+            c->lines = realloc(c->lines, c->cap * sizeof(struct SynapseLine));
+            if (c->keep_text) {
+                c->text = realloc(c->text, 2 * c->cap * sizeof(double));
+            }
+            if (!c->lines || (c->keep_text && !c->text)) {
+                MemFatal("network chunk");
+            }
+        }
+        if (c->keep_text) {
+            c->text[2 * c->n] = rel_w;
+            c->text[2 * c->n + 1] = delay;
+        }
+        c->lines[c->n].src_id = src_id;
+        c->lines[c->n].tgt_id = tgt_id;
+        c->lines[c->n].rel_w = (float)rel_w;
+        c->lines[c->n].delay = (float)delay;
+        c->n++;
+        c->count[tgt_id]++;
+    }
+    TRACE_END("network chunk");
+    return NULL;
+}
+
+/* places the chunk's synapses at the slots worked out by PhysNetworkReadFile */
+static void *network_chunk_place(void *arg) {
+
+    struct NetworkChunk *c = (struct NetworkChunk *)arg;
+    struct SynapseLine *l;
+    unsigned long idx, slot;
+
+    TRACE_THREAD_NAME("network placer", -1);
+    TRACE_BEGIN("network place");
+    for (idx = 0; idx < c->n; ++idx) {
+        l = &c->lines[idx];
+        slot = c->count[l->tgt_id]++;
+        network_set_synapse(c->pn, slot, l->src_id, l->rel_w, l->delay);
+        if (c->keep_text) {
+            c->pn->text_rel_w[slot] = c->text[2 * idx];
+            c->pn->text_delay[slot] = c->text[2 * idx + 1];
+        }
+    }
+    TRACE_END("network place");
+    return NULL;
+}
+
+/* runs fn on every chunk, one thread per chunk */
+static void network_chunks_run(struct NetworkChunk *chunks, int n_chunks, void *(*fn)(void *)) {
+
+    int idx;
+
+    if (n_chunks == 1) {
+        fn(&chunks[0]);
+        return;
+    }
+    for (idx = 0; idx < n_chunks; ++idx) {
+        if (pthread_create(&chunks[idx].thread, NULL, fn, &chunks[idx])) {
+            printf("FATAL: Unable to start network read thread %d\n", idx);
             exit(-1);
         }
+    }
+    for (idx = 0; idx < n_chunks; ++idx) {
+        pthread_join(chunks[idx].thread, NULL);
+    }
+}
+
+void PhysNetworkReadFile(struct PhysNetwork *pn, char *fname, int n_threads, int keep_text) {
+
+    /* 
+     * File format:
+     * <src_id> <tgt_id> <rel_w> <delay>
+     *
+     * Chunks of the file are parsed in parallel into per chunk lists.
+     * The per target counts of all chunks give each chunk its slots in
+     * the CSR arrays, and the chunks then fill them in parallel.
+     * With keep_text the weights and delays are also kept as parsed,
+     * in double, for PhysNetworkWriteCache.
+     */
 
-        field = strtok(NULL, " ");
-        delay = strtof(field, &end);
-        if (end == field) {
-            printf("FATAL: Unable to parse delay\n");
+    struct SpikeFile sf;
+    struct NetworkChunk *chunks;
+    size_t *bounds;
+    unsigned long cell, next, n;
+    int idx;
+
+    if (n_threads < 1) n_threads = 1;
+
+    /* Attempt to map file */
+    if (SpikeFileOpen(&sf, fname)) {
+        printf("FATAL: Unable to open synapse file %s\n", fname);
+        exit(-1);
+    }
+
+    chunks = calloc(n_threads, sizeof(struct NetworkChunk));
+    bounds = malloc((n_threads + 1) * sizeof(size_t));
+    if (!chunks || !bounds) {
+        printf("FATAL: Unable to allocate network chunks\n");
+        exit(-1);
+    }
+    SpikeFileSplit(&sf, n_threads, bounds);
+
+    for (idx = 0; idx < n_threads; ++idx) {
+        chunks[idx].pn = pn;
+        chunks[idx].keep_text = keep_text;
+        chunks[idx].begin = sf.data + bounds[idx];
+        chunks[idx].end = sf.data + bounds[idx + 1];
+        chunks[idx].count = calloc(pn->n_cells, sizeof(unsigned long));
+        if (!chunks[idx].count) {
+            printf("FATAL: Unable to allocate network chunks\n");
             exit(-1);
         }
+    }
 
-        syn = SynapseCreate(src_id, tgt_id, rel_w, delay);
-        PhysNetworkAddSynapse(pn, syn);
+    network_chunks_run(chunks, n_threads, network_chunk_read);
+    SpikeFileClose(&sf);
+
+    /* turn the counts into each chunk's first slot per target */
+    next = 0;
+    for (cell = 0; cell < pn->n_cells; ++cell) {
+        pn->offsets[cell] = next;
+        for (idx = 0; idx < n_threads; ++idx) {
+            n = chunks[idx].count[cell];
+            chunks[idx].count[cell] = next;
+            next += n;
+        }
     }
+    pn->offsets[pn->n_cells] = next;
+    pn->n_syns = next;
+    network_alloc_synapses(pn, keep_text);
+
+    network_chunks_run(chunks, n_threads, network_chunk_place);
 
-    fclose(syn_file);
+    for (idx = 0; idx < n_threads; ++idx) {
+        MemFree(MEM_SYNAPSE, chunks[idx].cap * network_line_bytes(keep_text));
+        free(chunks[idx].lines);
+        free(chunks[idx].text);
+        free(chunks[idx].count);
+    }
+    free(chunks);
+    free(bounds);
+}
+
+/*
+ * Writes the arrays of pn, read from network file fname with keep_text, to
+ * the binary cache next to it, and drops the weights and delays kept as
+ * parsed.  Returns -1 if the cache cannot be written.
+ */
+int PhysNetworkWriteCache(struct PhysNetwork *pn, char *fname) {
+
+    int res;
+
+    if (!pn->text_rel_w) return -1;
+    res = NetworkCacheWrite(fname, pn->n_cells, pn->n_syns, (const uint64_t *)pn->offsets, pn->src_id, pn->delay,
+                            pn->neg_log_rel_w, pn->rel_w, pn->text_rel_w, pn->text_delay);
+    network_free_text(pn);
+    return res;
+}
+
+/*
+ * Loads an initialized, empty network from the binary cache of network
+ * file fname, if there is an up to date one for this number of cells.
+ * The synapse arrays are used in place from the mapping; only the causal
+ * windows are allocated.  Returns -1 if there is no usable cache.
+ */
+int PhysNetworkMapCache(struct PhysNetwork *pn, char *fname) {
+
+    struct NetworkCache *nc;
+    uint64_t idx;
+
+    nc = malloc(sizeof(struct NetworkCache));
+    if (!nc) {
+        printf("FATAL: Unable to allocate network cache\n");
+        exit(-1);
+    }
+    if (NetworkCacheMap(nc, fname, pn->n_cells)) {
+        free(nc);
+        return -1;
+    }
+
+    for (idx = 0; idx < nc->hdr->n_items; ++idx) {
+        if (nc->src_id[idx] >= pn->n_cells) {
+            NetworkCacheUnmap(nc);
+            free(nc);
+            return -1;
+        }
+    }
+
+    MemFree(MEM_SYNAPSE, (pn->n_cells + 1) * sizeof(unsigned long));
+    free(pn->offsets);
+
+    pn->cache = nc;
+    pn->n_syns = nc->hdr->n_items;
+    pn->offsets = (unsigned long *)nc->offsets;
+    pn->src_id = (uint32_t *)nc->src_id;
+    pn->delay = (float *)nc->delay;
+    pn->neg_log_rel_w = (float *)nc->neg_log_rel_w;
+    pn->rel_w = (float *)nc->rel_w;
+
+    network_alloc_windows(pn);
+    for (idx = 0; idx < pn->n_syns; ++idx) {
+        pn->win_lo[idx] = 0;
+        pn->win_hi[idx] = -1;
+    }
+    return 0;
 }
 
 void SynapsePrint(struct Synapse *syn) {
@@ -162,19 +527,16 @@ void SynapsePrint(struct Synapse *syn) {
 
 void PhysNetworkPrint(struct PhysNetwork *pn) {
 
-    unsigned long idx;
-    struct Synapse *syn;
+    unsigned long idx, pos;
+    struct Synapse syn;
 
     if (!pn) return;
 
     for (idx=0; idx < pn->n_cells; ++idx) {
-
-        syn = pn->presyns[idx];
-        while (syn) {
-            SynapsePrint(syn);
-            syn = syn->next;
+        for (pos = pn->offsets[idx]; pos < pn->offsets[idx + 1]; ++pos) {
+            SynapseGet(pn, idx, pos, &syn);
+            SynapsePrint(&syn);
         }
     }
 
 }
-
@@ -27,8 +27,14 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
+#include <stdint.h>
+
+/*
+ * One synapse of a network, copied out of its arrays by SynapseGet.
+ */
 struct Synapse {
 
+    unsigned long idx;    /* position in the network arrays */
     unsigned long src_id; /* presynaptic id */
     unsigned long tgt_id; /* postsynaptic id */
 
@@ -36,24 +42,51 @@ struct Synapse {
     float neg_log_rel_w; /* negative log of the relative weight */
     float delay; /* axonal conduction delay */
 
-    struct Synapse *next;
+    /*
+     * Causal window: gamma passes the threshold exactly when the post spike
+     * follows the pre spike by win_lo .. win_hi (inclusive).
+     * Empty when win_lo > win_hi.
+     */
+    long win_lo;
+    long win_hi;
 };
 
+/*
+ * Synapses in compressed sparse row form, grouped by target cell in file
+ * order: the synapses onto cell i are offsets[i] .. offsets[i + 1] - 1 of
+ * the per-synapse arrays.  When loaded from a cache, offsets and the
+ * arrays up to rel_w are used in place from the read only mapping.
+ */
 struct PhysNetwork {
 
     unsigned long n_cells;
-    struct Synapse **presyns; /* list of lists of presynaptic partners */
+    unsigned long n_syns;
+
+    unsigned long *offsets; /* n_cells + 1 */
+    uint32_t *src_id;
+    float *delay;
+    float *neg_log_rel_w;
+    float *rel_w;
+    int32_t *win_lo; /* set by GNAT_compute_windows */
+    int32_t *win_hi;
+
+    /* weight and delay as parsed, kept by PhysNetworkReadFile for the cache, or NULL */
+    double *text_rel_w;
+    double *text_delay;
 
+    void *cache; /* struct NetworkCache the arrays are mapped from, or NULL */
 };
 
 /* Network api */
 
 int PhysNetworkInit(struct PhysNetwork *pn, unsigned long _n_cells);
-void PhysNetworkAddSynapse(struct PhysNetwork *pn, struct Synapse *edg);
-void PhysNetworkReadFile(struct PhysNetwork *pn, char *fname);
+void PhysNetworkFree(struct PhysNetwork *pn);
+void PhysNetworkReadFile(struct PhysNetwork *pn, char *fname, int n_threads, int keep_text);
 void PhysNetworkPrint(struct PhysNetwork *pn);
+int PhysNetworkWriteCache(struct PhysNetwork *pn, char *fname);
+int PhysNetworkMapCache(struct PhysNetwork *pn, char *fname);
 
-struct Synapse *SynapseCreate(unsigned long _src, unsigned long _tgt, float _rel_w, float delay);
+void SynapseGet(const struct PhysNetwork *pn, unsigned long tgt_id, unsigned long idx, struct Synapse *syn);
 
 void SynapsePrint(struct Synapse *syn);
 
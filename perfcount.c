@@ -0,0 +1,225 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfcount.h"
+
+int g_perf_enabled;
+
+static const char *perf_names[N_PERF_EVENTS] = {"cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"};
+
+/* process counters, inherited by new threads */
+static int g_proc_fd[N_PERF_EVENTS];
+
+/* counters of the calling thread, open while t_name is set */
+static _Thread_local int t_fd[N_PERF_EVENTS];
+static _Thread_local char t_name[32];
+
+/* threads that have finished counting */
+static pthread_mutex_t g_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct PerfThread *g_threads;
+static int g_n_threads, g_threads_cap;
+
+static int perf_open(enum PerfEvent ev, int inherit) {
+
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.inherit = inherit;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (ev) {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            return -1;
+    }
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * Reads the counters in fds, scaled up for the time a counter was
+ * multiplexed out
+ */
+static void perf_read_fds(const int *fds, struct PerfCounts *pc) {
+
+    uint64_t buf[3]; /* value, time enabled, time running */
+    int ev;
+
+    memset(pc, 0, sizeof(struct PerfCounts));
+    for (ev = 0; ev < N_PERF_EVENTS; ++ev) {
+        if (fds[ev] < 0) continue;
+        if (read(fds[ev], buf, sizeof(buf)) != sizeof(buf)) continue;
+        if (buf[2] && buf[2] < buf[1]) {
+            pc->v[ev] = (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+        } else {
+            pc->v[ev] = buf[0];
+        }
+        pc->valid |= 1u << ev;
+    }
+}
+
+/*
+ * Opens the process counters.  Returns -1, leaving counting off, if no
+ * event could be opened.
+ */
+int PerfEnable(void) {
+
+    int ev, n = 0;
+
+    for (ev = 0; ev < N_PERF_EVENTS; ++ev) {
+        g_proc_fd[ev] = perf_open(ev, 1);
+        if (g_proc_fd[ev] < 0) {
+            printf("WARNING: perf counter %s not available: %s\n", perf_names[ev], strerror(errno));
+        } else {
+            n++;
+        }
+    }
+    if (!n) {
+        printf("WARNING: No perf counters available, not counting\n");
+        return -1;
+    }
+
+    g_perf_enabled = 1;
+    return 0;
+}
+
+void PerfRead(struct PerfCounts *pc) {
+
+    perf_read_fds(g_proc_fd, pc);
+}
+
+/*
+ * Adds end - begin to sum for the events counted in both
+ */
+void PerfAccumulate(struct PerfCounts *sum, const struct PerfCounts *begin, const struct PerfCounts *end) {
+
+    int ev;
+
+    for (ev = 0; ev < N_PERF_EVENTS; ++ev) {
+        if (!(begin->valid & end->valid & (1u << ev))) continue;
+        sum->v[ev] += end->v[ev] - begin->v[ev];
+        sum->valid |= 1u << ev;
+    }
+}
+
+/*
+ * Starts counting the calling thread alone, as name or "name idx" if
+ * idx >= 0
+ */
+void PerfThreadBegin(const char *name, long idx) {
+
+    int ev;
+
+    if (!g_perf_enabled) return;
+
+    if (idx < 0) {
+        snprintf(t_name, sizeof(t_name), "%s", name);
+    } else {
+        snprintf(t_name, sizeof(t_name), "%s %ld", name, idx);
+    }
+    for (ev = 0; ev < N_PERF_EVENTS; ++ev) {
+        t_fd[ev] = perf_open(ev, 0);
+    }
+}
+
+/*
+ * Stops counting the calling thread and keeps its counts
+ */
+void PerfThreadEnd(void) {
+
+    struct PerfCounts pc;
+    int ev;
+
+    if (!t_name[0]) return;
+
+    perf_read_fds(t_fd, &pc);
+    for (ev = 0; ev < N_PERF_EVENTS; ++ev) {
+        if (t_fd[ev] >= 0) close(t_fd[ev]);
+    }
+
+    pthread_mutex_lock(&g_threads_lock);
+    if (g_n_threads == g_threads_cap) {
+        g_threads_cap = g_threads_cap ? 2 * g_threads_cap : 16;
+        g_threads = realloc(g_threads, g_threads_cap * sizeof(struct PerfThread));
+        if (!g_threads) {
+            printf("FATAL: Unable to allocate perf thread counts\n");
+            exit(-1);
+        }
+    }
+    memcpy(g_threads[g_n_threads].name, t_name, sizeof(t_name));
+    g_threads[g_n_threads].counts = pc;
+    g_n_threads++;
+    pthread_mutex_unlock(&g_threads_lock);
+
+    t_name[0] = '\0';
+}
+
+int PerfNThreads(void) {
+
+    return g_n_threads;
+}
+
+const struct PerfThread *PerfThreadGet(int idx) {
+
+    return &g_threads[idx];
+}
+
+const char *PerfEventName(enum PerfEvent ev) {
+
+    return perf_names[ev];
+}
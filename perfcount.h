@@ -0,0 +1,88 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hardware performance counters read through Linux perf_event_open.
+ *
+ * PerfEnable opens counters on the calling thread that are inherited by
+ * the threads it creates afterwards, so it must be called before any
+ * thread is started; PerfRead then gives process totals, which phasestats
+ * takes around each phase.  A thread's counts are added to the totals
+ * when it exits.
+ *
+ * PerfThreadBegin / PerfThreadEnd count a single thread, such as a search
+ * worker, and keep the result under the thread's name.
+ *
+ * Only user space is counted, which perf_event_paranoid up to 2 allows.
+ * Events the CPU or kernel does not offer are left out and marked so in
+ * PerfCounts.valid.
+ */
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,    /* last level cache read misses */
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,   /* data TLB read misses */
+    N_PERF_EVENTS
+};
+
+struct PerfCounts {
+
+    unsigned valid;            /* bit ev set if v[ev] was counted */
+    uint64_t v[N_PERF_EVENTS];
+};
+
+struct PerfThread {
+
+    char name[32];
+    struct PerfCounts counts;
+};
+
+extern int g_perf_enabled;
+
+int  PerfEnable(void);
+void PerfRead(struct PerfCounts *pc);
+void PerfAccumulate(struct PerfCounts *sum, const struct PerfCounts *begin, const struct PerfCounts *end);
+void PerfThreadBegin(const char *name, long idx);
+void PerfThreadEnd(void);
+int  PerfNThreads(void);
+const struct PerfThread *PerfThreadGet(int idx);
+const char *PerfEventName(enum PerfEvent ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,322 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "phasestats.h"
+#include "memstat.h"
+
+#define PHASE_INFO_MAX 32
+#define PHASE_COUNTER_MAX 32
+
+struct PhaseStats g_phases[N_PHASES];
+
+static const char *phase_names[N_PHASES] = {"parse", "raster_read", "network_read", "index", "search", "output"};
+
+/* start of the open phase of each kind */
+static struct timespec g_wall0[N_PHASES], g_cpu0[N_PHASES];
+static struct PerfCounts g_perf0[N_PHASES];
+
+/* phases between PhaseBegin and PhaseEnd */
+static int g_open[N_PHASES];
+
+/* run description, written ahead of the phases */
+static const char *g_info_key[PHASE_INFO_MAX];
+static const char *g_info_val[PHASE_INFO_MAX];
+static int g_n_info;
+
+/* named counters */
+static const char *g_counter_name[PHASE_COUNTER_MAX];
+static uint64_t g_counter_val[PHASE_COUNTER_MAX];
+static int g_n_counters;
+
+static double ts_diff(struct timespec *a, struct timespec *b) {
+
+    return (b->tv_sec - a->tv_sec) + 1e-9 * (b->tv_nsec - a->tv_nsec);
+}
+
+/* folds the RSS peak since the last phase boundary into the open phases */
+static void sample_rss(void) {
+
+    long kb = MemSampleRSS();
+    int idx;
+
+    for (idx = 0; idx < N_PHASES; ++idx) {
+        if (g_open[idx] && kb > g_phases[idx].peak_rss_kb) g_phases[idx].peak_rss_kb = kb;
+    }
+}
+
+void PhaseBegin(enum Phase ph) {
+
+    sample_rss();
+    g_open[ph] = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &g_wall0[ph]);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &g_cpu0[ph]);
+    if (g_perf_enabled) PerfRead(&g_perf0[ph]);
+}
+
+void PhaseEnd(enum Phase ph) {
+
+    struct timespec wall, cpu;
+    struct PerfCounts pc;
+
+    if (g_perf_enabled) {
+        PerfRead(&pc);
+        PerfAccumulate(&g_phases[ph].perf, &g_perf0[ph], &pc);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    sample_rss();
+    g_open[ph] = 0;
+
+    g_phases[ph].ran = 1;
+    g_phases[ph].wall_s += ts_diff(&g_wall0[ph], &wall);
+    g_phases[ph].cpu_s += ts_diff(&g_cpu0[ph], &cpu);
+}
+
+/*
+ * Adds key: value to the run description.  Both strings must outlive
+ * the call to PhaseStatsWrite.
+ */
+void PhaseInfo(const char *key, const char *value) {
+
+    if (g_n_info == PHASE_INFO_MAX) return;
+    g_info_key[g_n_info] = key;
+    g_info_val[g_n_info] = value;
+    g_n_info++;
+}
+
+/*
+ * Sets counter name, which must outlive the calls to PhaseStatsPrint and
+ * PhaseStatsWrite.
+ */
+void PhaseCounter(const char *name, uint64_t value) {
+
+    int idx;
+
+    for (idx = 0; idx < g_n_counters; ++idx) {
+        if (!strcmp(g_counter_name[idx], name)) break;
+    }
+    if (idx == PHASE_COUNTER_MAX) return;
+    if (idx == g_n_counters) {
+        g_counter_name[g_n_counters++] = name;
+    }
+    g_counter_val[idx] = value;
+}
+
+/* instructions per cycle, or -1 if either was not counted */
+static double perf_ipc(const struct PerfCounts *pc) {
+
+    unsigned need = (1u << PERF_CYCLES) | (1u << PERF_INSTRUCTIONS);
+
+    if ((pc->valid & need) != need || !pc->v[PERF_CYCLES]) return -1;
+    return (double)pc->v[PERF_INSTRUCTIONS] / pc->v[PERF_CYCLES];
+}
+
+/* misses of ev per 1000 instructions, or -1 if either was not counted */
+static double perf_mpki(const struct PerfCounts *pc, enum PerfEvent ev) {
+
+    unsigned need = (1u << ev) | (1u << PERF_INSTRUCTIONS);
+
+    if ((pc->valid & need) != need || !pc->v[PERF_INSTRUCTIONS]) return -1;
+    return 1000.0 * pc->v[ev] / pc->v[PERF_INSTRUCTIONS];
+}
+
+static void print_perf_row(const char *name, const struct PerfCounts *pc) {
+
+    double r[4];
+    int idx;
+
+    r[0] = perf_ipc(pc);
+    r[1] = perf_mpki(pc, PERF_LLC_MISSES);
+    r[2] = perf_mpki(pc, PERF_BRANCH_MISSES);
+    r[3] = perf_mpki(pc, PERF_DTLB_MISSES);
+
+    printf("%-14s", name);
+    for (idx = PERF_CYCLES; idx <= PERF_INSTRUCTIONS; ++idx) {
+        if (pc->valid & (1u << idx)) {
+            printf(" %16llu", (unsigned long long)pc->v[idx]);
+        } else {
+            printf(" %16s", "-");
+        }
+    }
+    for (idx = 0; idx < 4; ++idx) {
+        if (r[idx] < 0) {
+            printf(" %10s", "-");
+        } else {
+            printf(" %10.3f", r[idx]);
+        }
+    }
+    printf("\n");
+}
+
+/*
+ * Prints the phases that ran and the counters as a table
+ */
+void PhaseStatsPrint(void) {
+
+    int idx;
+
+    printf("%-14s %10s %10s %12s %14s %14s %14s\n", "phase", "wall s", "cpu s", "peak RSS kB", "pairs indexed", "candidates", "edges");
+    for (idx = 0; idx < N_PHASES; ++idx) {
+        if (!g_phases[idx].ran) continue;
+        printf("%-14s %10.3f %10.3f %12ld %14llu %14llu %14llu\n", phase_names[idx], g_phases[idx].wall_s,
+               g_phases[idx].cpu_s, g_phases[idx].peak_rss_kb, (unsigned long long)g_phases[idx].pairs_indexed,
+               (unsigned long long)g_phases[idx].candidates, (unsigned long long)g_phases[idx].edges);
+    }
+    for (idx = 0; idx < g_n_counters; ++idx) {
+        printf("%-20s %20llu\n", g_counter_name[idx], (unsigned long long)g_counter_val[idx]);
+    }
+
+    if (!g_perf_enabled) return;
+
+    printf("%-14s %16s %16s %10s %10s %10s %10s\n", "perf", "cycles", "instructions", "IPC", "LLC MPKI",
+           "branch MPKI", "dTLB MPKI");
+    for (idx = 0; idx < N_PHASES; ++idx) {
+        if (!g_phases[idx].ran) continue;
+        print_perf_row(phase_names[idx], &g_phases[idx].perf);
+    }
+    for (idx = 0; idx < PerfNThreads(); ++idx) {
+        print_perf_row(PerfThreadGet(idx)->name, &PerfThreadGet(idx)->counts);
+    }
+}
+
+/* writes s as a JSON string */
+static void json_string(FILE *fp, const char *s) {
+
+    fputc('"', fp);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(fp, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(fp, "\\u%04x", *s);
+        } else {
+            fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* writes the counted events of pc and the ratios they give as a JSON object */
+static void json_perf(FILE *fp, const struct PerfCounts *pc) {
+
+    static const char *ratio_names[] = {"ipc", "llc_mpki", "branch_mpki", "dtlb_mpki"};
+    double r[4];
+    int idx, first = 1;
+
+    r[0] = perf_ipc(pc);
+    r[1] = perf_mpki(pc, PERF_LLC_MISSES);
+    r[2] = perf_mpki(pc, PERF_BRANCH_MISSES);
+    r[3] = perf_mpki(pc, PERF_DTLB_MISSES);
+
+    fputc('{', fp);
+    for (idx = 0; idx < N_PERF_EVENTS; ++idx) {
+        if (!(pc->valid & (1u << idx))) continue;
+        fprintf(fp, "%s\"%s\": %llu", first ? "" : ", ", PerfEventName((enum PerfEvent)idx), (unsigned long long)pc->v[idx]);
+        first = 0;
+    }
+    for (idx = 0; idx < 4; ++idx) {
+        if (r[idx] < 0) continue;
+        fprintf(fp, "%s\"%s\": %.4f", first ? "" : ", ", ratio_names[idx], r[idx]);
+        first = 0;
+    }
+    fputc('}', fp);
+}
+
+/*
+ * Writes one JSON object with the run description and the phases that
+ * ran to fname.  Returns -1 if the file cannot be written.
+ */
+int PhaseStatsWrite(const char *fname, const char *program) {
+
+    FILE *fp;
+    int idx, first = 1;
+
+    fp = fopen(fname, "w");
+    if (!fp) {
+        printf("WARNING: Unable to open stats file %s\n", fname);
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"program\": ");
+    json_string(fp, program);
+    fprintf(fp, ",\n  \"info\": {");
+    for (idx = 0; idx < g_n_info; ++idx) {
+        fprintf(fp, "%s\n    ", idx ? "," : "");
+        json_string(fp, g_info_key[idx]);
+        fprintf(fp, ": ");
+        json_string(fp, g_info_val[idx]);
+    }
+    fprintf(fp, "\n  },\n  \"phases\": {");
+    for (idx = 0; idx < N_PHASES; ++idx) {
+        if (!g_phases[idx].ran) continue;
+        fprintf(fp, "%s\n    \"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f, \"peak_rss_kb\": %ld, "
+                "\"pairs_indexed\": %llu, \"candidates\": %llu, \"edges\": %llu",
+                first ? "" : ",", phase_names[idx], g_phases[idx].wall_s, g_phases[idx].cpu_s,
+                g_phases[idx].peak_rss_kb, (unsigned long long)g_phases[idx].pairs_indexed,
+                (unsigned long long)g_phases[idx].candidates, (unsigned long long)g_phases[idx].edges);
+        if (g_perf_enabled) {
+            fprintf(fp, ", \"perf\": ");
+            json_perf(fp, &g_phases[idx].perf);
+        }
+        fputc('}', fp);
+        first = 0;
+    }
+    fprintf(fp, "\n  },\n  \"counters\": {");
+    for (idx = 0; idx < g_n_counters; ++idx) {
+        fprintf(fp, "%s\n    ", idx ? "," : "");
+        json_string(fp, g_counter_name[idx]);
+        fprintf(fp, ": %llu", (unsigned long long)g_counter_val[idx]);
+    }
+    fprintf(fp, "\n  },\n  \"memory\": {\"peak_rss_kb\": %ld", MemPeakRSS());
+    for (idx = 0; idx < N_MEM_CATEGORIES; ++idx) {
+        if (!MemPeak((enum MemCategory)idx)) continue;
+        fprintf(fp, ",\n    \"%s\": {\"bytes\": %llu, \"peak_bytes\": %llu}", MemCategoryName((enum MemCategory)idx),
+                (unsigned long long)MemBytes((enum MemCategory)idx), (unsigned long long)MemPeak((enum MemCategory)idx));
+    }
+    fprintf(fp, "\n  }");
+    if (g_perf_enabled) {
+        fprintf(fp, ",\n  \"threads\": [");
+        for (idx = 0; idx < PerfNThreads(); ++idx) {
+            fprintf(fp, "%s\n    {\"name\": ", idx ? "," : "");
+            json_string(fp, PerfThreadGet(idx)->name);
+            fprintf(fp, ", \"perf\": ");
+            json_perf(fp, &PerfThreadGet(idx)->counts);
+            fputc('}', fp);
+        }
+        fprintf(fp, "\n  ]");
+    }
+    fprintf(fp, "\n}\n");
+
+    if (fclose(fp)) {
+        printf("WARNING: Unable to write stats file %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
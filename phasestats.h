@@ -0,0 +1,94 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PHASESTATS_H
+#define PHASESTATS_H
+
+#include <stdint.h>
+
+#include "perfcount.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per phase wall time, CPU time, peak RSS and work counters, shared by
+ * gnatfinder and gnat1 and written as JSON for benchmark runs.
+ *
+ * A phase may be entered several times; its times add up.  The peak RSS
+ * of a phase is the highest RSS while it ran, taken from the watermark
+ * that MemSampleRSS resets at every phase boundary; where the kernel
+ * does not allow the reset it is the process peak when the phase last
+ * ended.  Phases may nest: parse covers the raster and network reads.
+ *
+ * Named counters, such as the search counters summed over the threads,
+ * are listed after the phases.
+ *
+ * Once PerfEnable has succeeded each phase also gets the process's
+ * hardware counters, reported with IPC and misses per 1000 instructions,
+ * and the threads counted with PerfThreadBegin are listed last.
+ *
+ * The bytes held by each memory category (memstat.h) follow the phases.
+ */
+
+enum Phase {
+    PHASE_PARSE,  /* reading the activity and network files */
+    PHASE_RASTER, /* ... the activity file */
+    PHASE_NETWORK, /* ... the network file */
+    PHASE_INDEX,  /* building the spike pair index */
+    PHASE_SEARCH, /* finding edges */
+    PHASE_OUTPUT, /* writing what the search has not written yet */
+    N_PHASES
+};
+
+struct PhaseStats {
+
+    int ran;
+    double wall_s;
+    double cpu_s; /* all threads of the process */
+    long peak_rss_kb;
+
+    uint64_t pairs_indexed; /* spike pairs put in the index */
+    uint64_t candidates;    /* pre pairs considered by the search */
+    uint64_t edges;         /* edges emitted */
+
+    struct PerfCounts perf;
+};
+
+extern struct PhaseStats g_phases[N_PHASES];
+
+void PhaseBegin(enum Phase ph);
+void PhaseEnd(enum Phase ph);
+void PhaseInfo(const char *key, const char *value);
+void PhaseCounter(const char *name, uint64_t value);
+void PhaseStatsPrint(void);
+int  PhaseStatsWrite(const char *fname, const char *program);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
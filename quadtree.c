@@ -32,15 +32,31 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "quadtree.h"
+#include "memstat.h"
 
-struct Spike *create_spike(uint32_t neuron_id, long timestamp) {
+_Thread_local struct QTreeCounters qt_counters;
 
-    struct Spike *res = malloc(sizeof(struct Spike));
+/*
+ * Allocates size bytes from arena, or from malloc if arena is NULL
+ */
+static void *qt_alloc(struct Arena *arena, size_t size) {
+
+    if (arena) return ArenaAlloc(arena, size);
+    return malloc(size);
+}
+
+/*
+ * Spikes are made in bulk by the raster readers, which report their
+ * bytes to memstat once per chunk
+ */
+struct Spike *create_spike(struct Arena *arena, uint32_t neuron_id, long timestamp) {
+
+    struct Spike *res = qt_alloc(arena, sizeof(struct Spike));
     if (res == NULL) {
-        printf("FATAL: Unable to allocate Spike\n");
-        exit(1);
+        MemFatal("Spike");
     }
 
     res->n_id = neuron_id;
@@ -52,6 +68,7 @@ struct Spike *create_spike(uint32_t neuron_id, long timestamp) {
 
 void destroy_spike(struct Spike *sp) {
 
+    MemFree(MEM_SPIKE, sizeof(struct Spike));
     free(sp);
 
 }
@@ -73,13 +90,13 @@ void print_spike(struct Spike *sp) {
 
 /* SpikePair routines */
 
-struct SpikePair *create_spike_pair(struct Spike *_sp1, struct Spike *_sp2) {
+struct SpikePair *create_spike_pair(struct Arena *arena, struct Spike *_sp1, struct Spike *_sp2) {
 
-    struct SpikePair *res = malloc(sizeof(struct SpikePair));
+    struct SpikePair *res = qt_alloc(arena, sizeof(struct SpikePair));
     if (res == NULL) {
-        printf("FATAL: Unable to allocate SpikePair\n");
-        exit(1);
+        MemFatal("SpikePair");
     }
+    MemAlloc(MEM_SPIKE_PAIR, sizeof(struct SpikePair));
 
     /* check that the spikes belong to the same cell */
     if (_sp1->n_id != _sp2->n_id) {
@@ -113,6 +130,7 @@ void destroy_spike_pair(struct SpikePair *spp) {
         destroy_spike(spp->sp2);
     }
 
+    MemFree(MEM_SPIKE_PAIR, sizeof(struct SpikePair));
     free(spp);
 }
 
@@ -139,13 +157,13 @@ void print_spike_pair(struct SpikePair *spp) {
 
 /* BoundingBox routines */
 
-struct BoundingBox *BBoxCreate(float center_x, float center_y, float half_width) {
+struct BoundingBox *BBoxCreate(struct Arena *arena, float center_x, float center_y, float half_width) {
 
-    struct BoundingBox *res = malloc(sizeof(struct BoundingBox));
+    struct BoundingBox *res = qt_alloc(arena, sizeof(struct BoundingBox));
     if (res == NULL) {
-        printf("FATAL: Unable to allocate Bounding Box\n");
-        exit(1);
+        MemFatal("Bounding Box");
     }
+    MemAlloc(MEM_BBOX, sizeof(struct BoundingBox));
 
     res->c_x = center_x;
     res->c_y = center_y;
@@ -157,6 +175,7 @@ struct BoundingBox *BBoxCreate(float center_x, float center_y, float half_width)
 
 void BBoxDestroy(struct BoundingBox *bb) {
 
+    MemFree(MEM_BBOX, sizeof(struct BoundingBox));
     free(bb);
 }
 
@@ -164,8 +183,9 @@ int BBoxContainsPoint(struct BoundingBox *bb, struct SpikePair *spp) {
 
     int s1, s2;
 
-    s1 = (abs(spp->sp1->ts - bb->c_x) < bb->w2);
-    s2 = (abs(spp->sp2->ts - bb->c_y) < bb->w2);
+    /* half-open box [c - w2, c + w2) so that sibling boxes do not drop shared edges */
+    s1 = (spp->sp1->ts >= bb->c_x - bb->w2) && (spp->sp1->ts < bb->c_x + bb->w2);
+    s2 = (spp->sp2->ts >= bb->c_y - bb->w2) && (spp->sp2->ts < bb->c_y + bb->w2);
     return s1 && s2;
 
 }
@@ -176,25 +196,50 @@ int BBoxIntersects(struct BoundingBox *bb1, struct BoundingBox *bb2) {
     int b1, b2;
 
     d = bb1->w2 + bb2->w2;
-    b1 = (abs(bb2->c_x - bb1->c_x) <= d);
-    b2 = (abs(bb2->c_y - bb1->c_y) <= d);
+    b1 = (fabsf(bb2->c_x - bb1->c_x) <= d);
+    b2 = (fabsf(bb2->c_y - bb1->c_y) <= d);
+    return b1 && b2;
+
+}
+
+
+
+int BBoxIntersectsRange(struct BoundingBox *bb, struct QueryRange *r) {
+
+    int b1, b2;
+
+    b1 = (r->x_lo <= bb->c_x + bb->w2) && (r->x_hi >= bb->c_x - bb->w2);
+    b2 = (r->y_lo <= bb->c_y + bb->w2) && (r->y_hi >= bb->c_y - bb->w2);
     return b1 && b2;
 
 }
 
+/*
+ * TRUE if every integer point of bb lies inside r.
+ * A margin of one time unit absorbs float rounding of the box edges.
+ */
+int BBoxInsideRange(struct BoundingBox *bb, struct QueryRange *r) {
+
+    int b1, b2;
+
+    b1 = (r->x_lo <= bb->c_x - bb->w2 - 1) && (r->x_hi >= bb->c_x + bb->w2 + 1);
+    b2 = (r->y_lo <= bb->c_y - bb->w2 - 1) && (r->y_hi >= bb->c_y + bb->w2 + 1);
+    return b1 && b2;
+
+}
 
 
 /* QuadTree routines */
-static void QTreeSubdivide(struct QuadTree *qt);
+static void QTreeSubdivide(struct Arena *arena, struct QuadTree *qt);
 
-struct QuadTree *QTreeCreate(struct BoundingBox *bbox) {
+struct QuadTree *QTreeCreate(struct Arena *arena, struct BoundingBox *bbox) {
 
-    struct QuadTree *res = malloc(sizeof(struct QuadTree));
+    struct QuadTree *res = qt_alloc(arena, sizeof(struct QuadTree));
 
     if (res == NULL) {
-        printf("FATAL: Unable to allocate QuadTree\n");
-        exit(1);
+        MemFatal("QuadTree");
     }
+    MemAlloc(MEM_QTREE_NODE, sizeof(struct QuadTree));
 
     res->capacity = 0;
     res->bdry = bbox;
@@ -208,7 +253,7 @@ struct QuadTree *QTreeCreate(struct BoundingBox *bbox) {
     return res;
 }
 
-void QTreeSubdivide(struct QuadTree *qt) {
+void QTreeSubdivide(struct Arena *arena, struct QuadTree *qt) {
 
     /* build four new bounding boxes */
     float d2;
@@ -217,17 +262,18 @@ void QTreeSubdivide(struct QuadTree *qt) {
     struct BoundingBox *bbNE;
     struct BoundingBox *bbSE;
 
+    qt_counters.subdivisions++;
     d2 = qt->bdry->w2 / 2;
 
-    bbNW = BBoxCreate(qt->bdry->c_x - d2, qt->bdry->c_y + d2, d2);
-    bbSW = BBoxCreate(qt->bdry->c_x - d2, qt->bdry->c_y - d2, d2);
-    bbNE = BBoxCreate(qt->bdry->c_x + d2, qt->bdry->c_y + d2, d2);
-    bbSE = BBoxCreate(qt->bdry->c_x + d2, qt->bdry->c_y - d2, d2);
+    bbNW = BBoxCreate(arena, qt->bdry->c_x - d2, qt->bdry->c_y + d2, d2);
+    bbSW = BBoxCreate(arena, qt->bdry->c_x - d2, qt->bdry->c_y - d2, d2);
+    bbNE = BBoxCreate(arena, qt->bdry->c_x + d2, qt->bdry->c_y + d2, d2);
+    bbSE = BBoxCreate(arena, qt->bdry->c_x + d2, qt->bdry->c_y - d2, d2);
 
-    qt->NW = QTreeCreate(bbNW);
-    qt->SW = QTreeCreate(bbSW);
-    qt->NE = QTreeCreate(bbNE);
-    qt->SE = QTreeCreate(bbSE);
+    qt->NW = QTreeCreate(arena, bbNW);
+    qt->SW = QTreeCreate(arena, bbSW);
+    qt->NE = QTreeCreate(arena, bbNE);
+    qt->SE = QTreeCreate(arena, bbSE);
 
     while (qt->capacity > 0) {
 
@@ -239,20 +285,24 @@ void QTreeSubdivide(struct QuadTree *qt) {
         }
         qt->capacity--;
 
+        /* the pair is stored again below */
+        qt_counters.pairs_inserted--;
+        qt_counters.pairs_moved++;
+
         spp->next = (struct SpikePair *) NULL;
         spp->prev = (struct SpikePair *) NULL;
 
-        if (QTreeInsert(qt->NW, spp)) continue;
-        if (QTreeInsert(qt->SW, spp)) continue;
-        if (QTreeInsert(qt->NE, spp)) continue;
-        if (QTreeInsert(qt->SE, spp)) continue;
+        if (QTreeInsert(arena, qt->NW, spp)) continue;
+        if (QTreeInsert(arena, qt->SW, spp)) continue;
+        if (QTreeInsert(arena, qt->NE, spp)) continue;
+        if (QTreeInsert(arena, qt->SE, spp)) continue;
 
     }
 
 }
 
 
-int QTreeInsert(struct QuadTree *qt, struct SpikePair *spp) {
+int QTreeInsert(struct Arena *arena, struct QuadTree *qt, struct SpikePair *spp) {
 
     /* if spike pair is not in our bounding box, return FALSE */
     if (!BBoxContainsPoint(qt->bdry, spp)) {
@@ -276,28 +326,29 @@ int QTreeInsert(struct QuadTree *qt, struct SpikePair *spp) {
         spp->prev = ll;
         spp->next = (struct SpikePair *) NULL;
         qt->capacity++;
+        qt_counters.pairs_inserted++;
         return TRUE;
     }
 
     /* If we haven't been subdivided yet, do subdivision */
     if (!qt->NW) {
-        QTreeSubdivide(qt);
+        QTreeSubdivide(arena, qt);
     }
 
     /* Insert new spike pair into quad tree */
-    if (QTreeInsert(qt->NW, spp)) {
+    if (QTreeInsert(arena, qt->NW, spp)) {
         return TRUE;
     }
 
-    if (QTreeInsert(qt->SW, spp)) {
+    if (QTreeInsert(arena, qt->SW, spp)) {
         return TRUE;
     }
 
-    if (QTreeInsert(qt->NE, spp)) {
+    if (QTreeInsert(arena, qt->NE, spp)) {
         return TRUE;
     }
 
-    if (QTreeInsert(qt->SE, spp)) {
+    if (QTreeInsert(arena, qt->SE, spp)) {
         return TRUE;
     }
 
@@ -335,6 +386,74 @@ void QTreeMapQueryRange(struct QuadTree *qt, struct BoundingBox *r, void (*func)
 }
 
 
+/*
+ * Bytes used by the tree, its bounding boxes and its spike pairs,
+ * not counting allocator overhead.  The root bounding box is shared
+ * between trees and is not counted.
+ */
+unsigned long QTreeMemory(struct QuadTree *qt) {
+
+    unsigned long res;
+
+    if (!qt) return 0;
+
+    res = sizeof(struct QuadTree) + qt->capacity * sizeof(struct SpikePair);
+
+    if (qt->NW) {
+        res += 4 * sizeof(struct BoundingBox);
+        res += QTreeMemory(qt->NW);
+        res += QTreeMemory(qt->SW);
+        res += QTreeMemory(qt->NE);
+        res += QTreeMemory(qt->SE);
+    }
+    return res;
+}
+
+/* bytes one object of size takes from an arena, or from malloc with its chunk header */
+static unsigned long qt_object_bytes(size_t size, int use_arena) {
+
+    if (use_arena) return (size + 7) & ~(size_t)7;
+    size = (size + sizeof(size_t) + 15) & ~(size_t)15;
+    return (size < 32) ? 32 : size;
+}
+
+/*
+ * Bytes of the objects of a tree over n_pairs spike pairs.  Every
+ * subdivision of a full leaf makes four nodes, so there are about
+ * 4 / QT_MAX_CAP nodes, each with a box, per pair.
+ */
+static unsigned long qt_estimate_objects(unsigned long n_pairs, int use_arena) {
+
+    unsigned long n_nodes = 4 * n_pairs / QT_MAX_CAP + 1;
+
+    return n_pairs * qt_object_bytes(sizeof(struct SpikePair), use_arena)
+         + n_nodes * (qt_object_bytes(sizeof(struct QuadTree), use_arena) +
+                      qt_object_bytes(sizeof(struct BoundingBox), use_arena));
+}
+
+/*
+ * Bytes that a tree over n_pairs spike pairs is expected to take, with
+ * its own arena from QTreeArenaCreate if use_arena
+ */
+unsigned long QTreeEstimateMemory(unsigned long n_pairs, int use_arena) {
+
+    unsigned long res = qt_estimate_objects(n_pairs, use_arena);
+
+    if (use_arena) {
+        res += qt_object_bytes(sizeof(struct Arena), 0) + qt_object_bytes(sizeof(struct ArenaBlock), 0);
+    }
+    return res;
+}
+
+/*
+ * Creates an arena for a tree over n_pairs spike pairs, whose first block
+ * is sized to hold the whole tree
+ */
+struct Arena *QTreeArenaCreate(unsigned long n_pairs) {
+
+    return ArenaCreate(qt_estimate_objects(n_pairs, 1));
+}
+
 void QTreePrint(struct QuadTree *qt) {
 
     if (!qt) return;
@@ -29,6 +29,8 @@
 
 #include <stdint.h>
 
+#include "arena.h"
+
 #define QT_MAX_CAP 4
 #define FALSE 0
 #define TRUE  1 
@@ -60,6 +62,19 @@ struct BoundingBox {
 
 };
 
+/*
+ * Query region for spike pair searches.
+ * Inclusive integer bounds on the first (x) and second (y) spike time.
+ */
+struct QueryRange {
+
+    long x_lo;
+    long x_hi;
+    long y_lo;
+    long y_hi;
+
+};
+
 struct QuadTree {
 
     int capacity;
@@ -76,25 +91,45 @@ struct QuadTree {
 
 /* prototypes */
 
-struct Spike *create_spike(uint32_t neuron_id, long timestamp);
+/*
+ * Objects are taken from arena when one is given, otherwise from malloc.
+ * Only malloc'd objects may be passed to the destroy routines.
+ */
+
+struct Spike *create_spike(struct Arena *arena, uint32_t neuron_id, long timestamp);
 void          destroy_spike(struct Spike *sp);
 int           spike_equals(struct Spike *sp1, struct Spike *sp2);
 void          print_spike(struct Spike *sp);
 
 
-struct SpikePair *create_spike_pair(struct Spike *sp1, struct Spike *sp2);
+struct SpikePair *create_spike_pair(struct Arena *arena, struct Spike *sp1, struct Spike *sp2);
 void              destroy_spike_pair(struct SpikePair *spp);
 void              print_spike_pair(struct SpikePair *spp);
 
-struct BoundingBox *BBoxCreate(float center_x, float center_y, float half_width);
+struct BoundingBox *BBoxCreate(struct Arena *arena, float center_x, float center_y, float half_width);
 void                BBoxDestroy(struct BoundingBox *bb);
 int                 BBoxContainsPoint(struct BoundingBox *bb, struct SpikePair *spp);
 int                 BBoxIntersects(struct BoundingBox *bb1, struct BoundingBox *bb2);
+int                 BBoxIntersectsRange(struct BoundingBox *bb, struct QueryRange *r);
+int                 BBoxInsideRange(struct BoundingBox *bb, struct QueryRange *r);
+
+
+/* quadtree build counters, kept per thread */
+struct QTreeCounters {
+
+    unsigned long pairs_inserted; /* pairs stored in a tree */
+    unsigned long pairs_moved;    /* pairs pushed down by subdivisions */
+    unsigned long subdivisions;
+};
 
+extern _Thread_local struct QTreeCounters qt_counters;
 
-struct QuadTree *QTreeCreate(struct BoundingBox *bb);
-int QTreeInsert(struct QuadTree *qt, struct SpikePair *spp);
+struct QuadTree *QTreeCreate(struct Arena *arena, struct BoundingBox *bb);
+int QTreeInsert(struct Arena *arena, struct QuadTree *qt, struct SpikePair *spp);
 void QTreeMapQueryRange(struct QuadTree *qt, struct BoundingBox *r, void (*func)(struct SpikePair *));
+unsigned long QTreeMemory(struct QuadTree *qt);
+unsigned long QTreeEstimateMemory(unsigned long n_pairs, int use_arena);
+struct Arena *QTreeArenaCreate(unsigned long n_pairs);
 void QTreePrint(struct QuadTree *qt);
 
 #endif
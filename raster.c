@@ -27,11 +27,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "quadtree.h"
 #include "raster.h"
+#include "spikefile.h"
+#include "arena.h"
+#include "gnatcache.h"
+#include "trace.h"
+#include "memstat.h"
 
-#define LINE_MAX 256
 
 /*
  * Raster Routines
@@ -44,7 +49,7 @@
 int RasterInit(struct SpikeRaster *sr, const unsigned int _n_cells) {
 
     sr->n_cells = _n_cells;
-    sr->sp_lists = (struct Spike **)malloc(_n_cells * sizeof(struct Spike *));
+    sr->sp_lists = (struct Spike **)calloc(_n_cells, sizeof(struct Spike *));
     if (!sr->sp_lists) {
         printf("FATAL:  Unable to Allocate Spike Lists for Raster\n");
         exit(-1);
@@ -52,6 +57,11 @@ int RasterInit(struct SpikeRaster *sr, const unsigned int _n_cells) {
     sr->t_min = 0;
     sr->t_max = 0;
     sr->n_spikes = 0;
+    sr->n_typed = 0;
+    sr->sp_offsets = (unsigned long *)NULL;
+    sr->sp_times = (long *)NULL;
+    sr->arena = (struct Arena *)NULL;
+    sr->cache = NULL;
     return 0;
 }
 
@@ -123,62 +133,254 @@ void RasterReverse(struct SpikeRaster *sr) {
     }
 }
 
+/*
+ * One newline aligned piece of the activity file, parsed by its own thread
+ * into time ordered per cell runs of spikes
+ */
+struct RasterChunk {
+
+    pthread_t thread;
+    struct SpikeRaster *sr;
+    const struct SpikeFile *sf;
+    const char *begin;
+    const char *end;
+
+    struct Spike **head; /* first spike of each cell's run */
+    struct Spike **tail; /* last spike of each cell's run */
+    struct Arena *arena; /* NULL when spikes are allocated with malloc */
+
+    long t_min;
+    long t_max;
+    unsigned long n_spikes;
+    unsigned long n_typed;
+};
+
+static void *raster_chunk_read(void *arg) {
+
+    struct RasterChunk *c = (struct RasterChunk *)arg;
+    struct SpikeRecord recs[SPIKE_BATCH];
+    const char *pos = c->begin, *released = c->begin;
+    size_t n, idx;
+    struct Spike *sp;
+
+    TRACE_THREAD_NAME("raster reader", -1);
+    TRACE_BEGIN("raster chunk");
+    while ((n = SpikeParse(&pos, c->end, recs, SPIKE_BATCH))) {
+        for (idx = 0; idx < n; ++idx) {
+            if (recs[idx].n_id >= c->sr->n_cells) {
+                printf("FATAL: Attempting to add spike from neuron outside of raster population\n");
+                exit(-1);
+            }
+            sp = create_spike(c->arena, recs[idx].n_id, recs[idx].ts);
+
+            /* the file is time sorted, so appending keeps each run sorted */
+            if (c->tail[sp->n_id]) {
+                c->tail[sp->n_id]->next = sp;
+            } else {
+                c->head[sp->n_id] = sp;
+            }
+            c->tail[sp->n_id] = sp;
+
+            if (!c->n_spikes || sp->ts < c->t_min) c->t_min = sp->ts;
+            if (!c->n_spikes || sp->ts > c->t_max) c->t_max = sp->ts;
+            c->n_spikes++;
+            c->n_typed += (recs[idx].type != 0);
+        }
+        SpikeFileRelease(c->sf, &released, pos);
+    }
+    MemAlloc(MEM_SPIKE, c->n_spikes * sizeof(struct Spike));
+    TRACE_END("raster chunk");
+    return NULL;
+}
+
 /*
  * Reads spikes from a file into raster sr 
  * Assumes raster has been initialized
  * Also assumes that the file contains spikes in time sorted order
+ *
+ * The file is split into n_threads newline aligned chunks parsed in
+ * parallel.  The runs of each cell are then linked in chunk order, which
+ * keeps every spike list time sorted without a sort.  With an arena, each
+ * thread allocates from its own arena, merged into sr->arena at the end.
  */
-void RasterReadFile(struct SpikeRaster *sr, const char *fname) {
+void RasterReadFile(struct SpikeRaster *sr, const char *fname, int n_threads) {
+
+    struct SpikeFile sf;
+    struct RasterChunk *chunks;
+    struct Spike *last;
+    size_t *bounds;
+    unsigned int cell;
+    int idx;
 
-    /* open file */
-    FILE *sp_file;
+    if (n_threads < 1) n_threads = 1;
 
-    sp_file = fopen(fname, "r");
-    if (!sp_file) {
+    /* map file */
+    if (SpikeFileOpen(&sf, fname)) {
         printf("FATAL: Could not open spike file %s\n", fname);
         exit(-1);
     }
 
-    /* for each line create a spike */
-    char line[LINE_MAX];
-    char *field, *end;
-    long _ts, _n_id, _sp_type;
-    struct Spike *sp;
-    while (fgets(line, LINE_MAX, sp_file)) {
-        /*
-         * Line format is <type> <timestamp> <neuron_id>
-         */
-        field = strtok(line, " ");
-        _sp_type = strtol(field, &end, 0);
-        if (end == field) {
-            printf("FATAL: Unable to parse spike type\n");
+    chunks = calloc(n_threads, sizeof(struct RasterChunk));
+    bounds = malloc((n_threads + 1) * sizeof(size_t));
+    if (!chunks || !bounds) {
+        printf("FATAL: Unable to allocate raster chunks\n");
+        exit(-1);
+    }
+    SpikeFileSplit(&sf, n_threads, bounds);
+
+    for (idx = 0; idx < n_threads; ++idx) {
+        chunks[idx].sr = sr;
+        chunks[idx].sf = &sf;
+        chunks[idx].begin = sf.data + bounds[idx];
+        chunks[idx].end = sf.data + bounds[idx + 1];
+        chunks[idx].head = calloc(sr->n_cells, sizeof(struct Spike *));
+        chunks[idx].tail = calloc(sr->n_cells, sizeof(struct Spike *));
+        if (!chunks[idx].head || !chunks[idx].tail) {
+            printf("FATAL: Unable to allocate raster chunks\n");
             exit(-1);
         }
+        chunks[idx].arena = sr->arena ? ArenaCreate(0) : (struct Arena *)NULL;
+    }
 
-        field = strtok(NULL, " ");
-        _ts = strtol(field, &end, 16);
-        if (end == field) {
-            printf("FATAL: Unable to parse timestamp\n");
-            exit(-1);
+    /* for each line create a spike */
+    if (n_threads == 1) {
+        raster_chunk_read(&chunks[0]);
+    } else {
+        for (idx = 0; idx < n_threads; ++idx) {
+            if (pthread_create(&chunks[idx].thread, NULL, raster_chunk_read, &chunks[idx])) {
+                printf("FATAL: Unable to start raster read thread %d\n", idx);
+                exit(-1);
+            }
         }
+        for (idx = 0; idx < n_threads; ++idx) {
+            pthread_join(chunks[idx].thread, NULL);
+        }
+    }
 
-        field = strtok(NULL, " ");
-        _n_id = strtol(field, &end, 0);
-        if (end == field) {
-            printf("FATAL: Unable to parse neuron id\n");
-            exit(-1);
+    /* done with the file */
+    SpikeFileClose(&sf);
+
+    /* link the runs of each cell in chunk order, after any spikes already there */
+    for (cell = 0; cell < sr->n_cells; ++cell) {
+        for (last = sr->sp_lists[cell]; last && last->next; last = last->next);
+        for (idx = 0; idx < n_threads; ++idx) {
+            if (!chunks[idx].head[cell]) continue;
+            if (last) {
+                last->next = chunks[idx].head[cell];
+            } else {
+                sr->sp_lists[cell] = chunks[idx].head[cell];
+            }
+            last = chunks[idx].tail[cell];
         }
+    }
 
-        sp = create_spike(_n_id, _ts);
-        /* add spike to raster */
-        RasterHeadAppend(sr, sp);
+    for (idx = 0; idx < n_threads; ++idx) {
+        if (chunks[idx].n_spikes) {
+            if (!sr->n_spikes || chunks[idx].t_min < sr->t_min) sr->t_min = chunks[idx].t_min;
+            if (!sr->n_spikes || chunks[idx].t_max > sr->t_max) sr->t_max = chunks[idx].t_max;
+            sr->n_spikes += chunks[idx].n_spikes;
+            sr->n_typed += chunks[idx].n_typed;
+        }
+        ArenaMerge(sr->arena, chunks[idx].arena);
+        free(chunks[idx].head);
+        free(chunks[idx].tail);
     }
+    free(chunks);
+    free(bounds);
+}
 
-    /* done with the file */
-    fclose(sp_file);
+/*
+ * Copies the spike lists into the flat sp_offsets/sp_times arrays
+ */
+void RasterBuildArrays(struct SpikeRaster *sr) {
+
+    unsigned int idx;
+    unsigned long pos = 0;
+    struct Spike *sp;
+
+    /* already there, possibly mapped from a cache */
+    if (sr->sp_offsets) return;
 
-    /* after all spikes added, reverse the raster */
-    RasterReverse(sr);
+    sr->sp_offsets = (unsigned long *)malloc((sr->n_cells + 1) * sizeof(unsigned long));
+    sr->sp_times = (long *)malloc((sr->n_spikes + 1) * sizeof(long));
+    if (!sr->sp_offsets || !sr->sp_times) {
+        MemFatal("Spike Arrays for Raster");
+    }
+    MemAlloc(MEM_SPIKE, (sr->n_cells + 1) * sizeof(unsigned long) + (sr->n_spikes + 1) * sizeof(long));
+
+    for (idx = 0; idx < sr->n_cells; ++idx) {
+        sr->sp_offsets[idx] = pos;
+        for (sp = sr->sp_lists[idx]; sp; sp = sp->next) {
+            sr->sp_times[pos++] = sp->ts;
+        }
+    }
+    sr->sp_offsets[sr->n_cells] = pos;
+}
+
+/*
+ * Writes the flat spike arrays to the binary cache next to activity
+ * file fname.  Returns -1 if it cannot be written.
+ */
+int RasterWriteCache(struct SpikeRaster *sr, const char *fname) {
+
+    RasterBuildArrays(sr);
+    return RasterCacheWrite(fname, sr->n_cells, sr->n_spikes, (const uint64_t *)sr->sp_offsets,
+                            (const int64_t *)sr->sp_times, sr->n_typed, sr->t_min, sr->t_max);
+}
+
+/*
+ * Loads an initialized, empty raster from the binary cache of activity
+ * file fname, if there is an up to date one for this number of cells.
+ * The flat arrays are used in place from the mapping and the spike lists
+ * are linked over one block of spikes.  Returns -1 if there is no usable cache.
+ */
+int RasterMapCache(struct SpikeRaster *sr, const char *fname) {
+
+    struct RasterCache *rc;
+    struct Spike *block;
+    unsigned int idx;
+    unsigned long pos;
+
+    rc = malloc(sizeof(struct RasterCache));
+    if (!rc) {
+        printf("FATAL: Unable to allocate raster cache\n");
+        exit(-1);
+    }
+    if (RasterCacheMap(rc, fname, sr->n_cells)) {
+        free(rc);
+        return -1;
+    }
+
+    sr->cache = rc;
+    sr->n_spikes = rc->hdr->n_items;
+    sr->n_typed = rc->hdr->n_typed;
+    sr->t_min = rc->hdr->t_min;
+    sr->t_max = rc->hdr->t_max;
+    sr->sp_offsets = (unsigned long *)rc->offsets;
+    sr->sp_times = (long *)rc->times;
+
+    if (sr->arena) {
+        block = ArenaAlloc(sr->arena, (sr->n_spikes + 1) * sizeof(struct Spike));
+    } else {
+        block = malloc((sr->n_spikes + 1) * sizeof(struct Spike));
+        if (!block) {
+            MemFatal("spikes");
+        }
+    }
+    MemAlloc(MEM_SPIKE, (sr->n_spikes + 1) * sizeof(struct Spike));
+
+    for (idx = 0; idx < sr->n_cells; ++idx) {
+        sr->sp_lists[idx] = (struct Spike *)NULL;
+        for (pos = sr->sp_offsets[idx]; pos < sr->sp_offsets[idx + 1]; ++pos) {
+            block[pos].n_id = idx;
+            block[pos].ts = sr->sp_times[pos];
+            block[pos].next = (pos + 1 < sr->sp_offsets[idx + 1]) ? &block[pos + 1] : (struct Spike *)NULL;
+        }
+        if (sr->sp_offsets[idx + 1] > sr->sp_offsets[idx]) {
+            sr->sp_lists[idx] = &block[sr->sp_offsets[idx]];
+        }
+    }
+    return 0;
 }
 
 void RasterPrint(struct SpikeRaster *sr) {
@@ -33,12 +33,27 @@ struct SpikeRaster {
     long t_min;
     long t_max;
     unsigned long n_spikes;
+    unsigned long n_typed; /* spikes whose type was not 0 */
     struct Spike **sp_lists; /* array of linked lists of spikes */
 
+    /* 
+     * Flat copy of the spike lists: spike times of cell i are
+     * sp_times[sp_offsets[i]] .. sp_times[sp_offsets[i+1] - 1], time sorted
+     */
+    unsigned long *sp_offsets;
+    long *sp_times;
+
+    struct Arena *arena; /* spikes are allocated here if set, otherwise with malloc */
+
+    void *cache; /* struct RasterCache the arrays are mapped from, or NULL */
+
 };
 
 int RasterInit(struct SpikeRaster *, const unsigned int);
-void RasterReadFile(struct SpikeRaster *, const char *);
+void RasterReadFile(struct SpikeRaster *, const char *, int);
+void RasterBuildArrays(struct SpikeRaster *);
+int RasterWriteCache(struct SpikeRaster *, const char *);
+int RasterMapCache(struct SpikeRaster *, const char *);
 void RasterPrint(struct SpikeRaster *);
 
 #endif
@@ -0,0 +1,247 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Activity file parsing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "spikefile.h"
+
+/* value of each hex digit */
+static const unsigned char hex_value[256] = {
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+/* 1 for hex digits, 0 for anything else */
+static const unsigned char hex_digit[256] = {
+    ['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1,
+    ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+    ['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1,
+    ['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1,
+};
+
+/*
+ * Maps fname read only.  Returns -1 if it cannot be opened.
+ */
+int SpikeFileOpen(struct SpikeFile *sf, const char *fname) {
+
+    struct stat st;
+    void *map;
+
+    sf->fd = open(fname, O_RDONLY);
+    if (sf->fd < 0 || fstat(sf->fd, &st)) {
+        if (sf->fd >= 0) close(sf->fd);
+        return -1;
+    }
+    sf->size = st.st_size;
+    sf->data = NULL;
+    if (!sf->size) return 0;
+
+    map = mmap(NULL, sf->size, PROT_READ, MAP_PRIVATE, sf->fd, 0);
+    if (map == MAP_FAILED) {
+        close(sf->fd);
+        return -1;
+    }
+    madvise(map, sf->size, MADV_SEQUENTIAL);
+    sf->data = (const char *) map;
+    return 0;
+}
+
+void SpikeFileClose(struct SpikeFile *sf) {
+
+    if (sf->data) munmap((void *) sf->data, sf->size);
+    close(sf->fd);
+    sf->data = NULL;
+    sf->size = 0;
+}
+
+/*
+ * Drops the pages of text between *released and pos once more than
+ * SPIKE_RELEASE_BYTES have been parsed, so the mapping does not add the
+ * whole file to the resident set, and advances *released.  The text is
+ * not needed again; a page shared with a neighbouring chunk is simply
+ * read back from the file if that chunk touches it later.
+ */
+void SpikeFileRelease(const struct SpikeFile *sf, const char **released, const char *pos) {
+
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t from = ((size_t)(*released - sf->data) + page - 1) / page * page;
+    size_t upto = (size_t)(pos - sf->data) / page * page;
+
+    if (!sf->data || upto < from + SPIKE_RELEASE_BYTES) return;
+
+    madvise((void *)(sf->data + from), upto - from, MADV_DONTNEED);
+    *released = sf->data + upto;
+}
+
+/*
+ * First '\n' in [p, end), or end.  Compares 16 bytes at a time.
+ */
+const char *SpikeFindNewline(const char *p, const char *end) {
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    int mask;
+
+    while (end - p >= 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), nl));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+/*
+ * Splits the file into n_chunks pieces of about equal size that start at
+ * line starts.  Chunk i is [bounds[i], bounds[i + 1]), and may be empty.
+ */
+void SpikeFileSplit(const struct SpikeFile *sf, int n_chunks, size_t *bounds) {
+
+    const char *nl;
+    size_t pos;
+    int idx;
+
+    bounds[0] = 0;
+    for (idx = 1; idx < n_chunks; ++idx) {
+        pos = sf->size / n_chunks * idx;
+        if (pos < bounds[idx - 1]) pos = bounds[idx - 1];
+        if (pos > 0 && pos < sf->size) {
+            /* the chunk starts after the line containing byte pos - 1 */
+            nl = SpikeFindNewline(sf->data + pos - 1, sf->data + sf->size);
+            pos = (nl < sf->data + sf->size) ? (size_t)(nl - sf->data) + 1 : sf->size;
+        }
+        bounds[idx] = pos;
+    }
+    bounds[n_chunks] = sf->size;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+/* decimal integer at p, NULL if there is none; types and neuron ids are decimal, as in gnat1 */
+static const char *parse_dec(const char *p, const char *end, long *val) {
+
+    long v = 0;
+    int neg = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = 10 * v + (*p - '0');
+        p++;
+    }
+    *val = neg ? -v : v;
+    return p;
+}
+
+/* hexadecimal integer at p with an optional 0x prefix, NULL if there is none */
+static const char *parse_hex(const char *p, const char *end, long *val) {
+
+    unsigned long v = 0;
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hex_digit[(unsigned char) p[2]]) {
+        p += 2;
+    }
+    if (p >= end || !hex_digit[(unsigned char) *p]) return NULL;
+    while (p < end && hex_digit[(unsigned char) *p]) {
+        v = (v << 4) | hex_value[(unsigned char) *p];
+        p++;
+    }
+    *val = (long) v;
+    return p;
+}
+
+/*
+ * Parses up to max spikes from the text at *pos, stopping at end, and
+ * advances *pos past the lines parsed.  Returns the number parsed, 0 once
+ * the text is exhausted.  Exits on a malformed line.
+ */
+size_t SpikeParse(const char **pos, const char *end, struct SpikeRecord *out, size_t max) {
+
+    const char *p = *pos, *q;
+    long type, ts, n_id;
+    size_t n = 0;
+
+    while (n < max && p < end) {
+
+        p = skip_blanks(p, end);
+        if (p < end && (*p == '\n' || *p == '\r')) {
+            p++;
+            continue;
+        }
+        if (p >= end) break;
+
+        q = parse_dec(p, end, &type);
+        if (!q) {
+            printf("FATAL: Unable to parse spike type\n");
+            exit(-1);
+        }
+        q = parse_hex(skip_blanks(q, end), end, &ts);
+        if (!q) {
+            printf("FATAL: Unable to parse timestamp\n");
+            exit(-1);
+        }
+        q = parse_dec(skip_blanks(q, end), end, &n_id);
+        if (!q) {
+            printf("FATAL: Unable to parse neuron id\n");
+            exit(-1);
+        }
+
+        out[n].type = (int) type;
+        out[n].ts = ts;
+        out[n].n_id = (unsigned long) n_id;
+        n++;
+
+        /* rest of the line */
+        p = SpikeFindNewline(q, end);
+        if (p < end) p++;
+    }
+
+    *pos = p;
+    return n;
+}
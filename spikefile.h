@@ -0,0 +1,73 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SPIKEFILE_H
+#define SPIKEFILE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory mapped activity file reader, shared by gnatfinder and gnat1.
+ *
+ * The mapping and line splitting are also used for network files.
+ *
+ * Lines have the format <type> <timestamp> <neuron id>, with type and
+ * neuron id in decimal and the timestamp in hexadecimal.  Blank lines
+ * are skipped and anything after the neuron id is ignored.
+ */
+
+struct SpikeFile {
+
+    int fd;
+    size_t size;
+    const char *data; /* NULL for an empty file */
+};
+
+struct SpikeRecord {
+
+    long ts;
+    unsigned long n_id;
+    int type;
+};
+
+#define SPIKE_BATCH 4096              /* records parsed per call by the readers */
+#define SPIKE_RELEASE_BYTES (16 << 20) /* parsed bytes kept mapped before release */
+
+int         SpikeFileOpen(struct SpikeFile *sf, const char *fname);
+void        SpikeFileClose(struct SpikeFile *sf);
+void        SpikeFileRelease(const struct SpikeFile *sf, const char **released, const char *pos);
+void        SpikeFileSplit(const struct SpikeFile *sf, int n_chunks, size_t *bounds);
+const char *SpikeFindNewline(const char *p, const char *end);
+size_t      SpikeParse(const char **pos, const char *end, struct SpikeRecord *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
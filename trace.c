@@ -0,0 +1,206 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef GNAT_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define TRACE_NAME_MAX 32
+
+struct TraceEvent {
+
+    const char *name;     /* static string */
+    const char *arg_name; /* static string or NULL */
+    long arg;
+    uint64_t ts_ns;
+    char ph;              /* 'B' or 'E' */
+};
+
+/* events of one thread */
+struct TraceBuf {
+
+    int tid;
+    int named;
+    char name[TRACE_NAME_MAX];
+    struct TraceEvent *events;
+    unsigned long n, cap;
+    struct TraceBuf *next;
+};
+
+static int g_trace_on;
+static struct TraceBuf *g_trace_bufs;
+static int g_trace_n_threads;
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_trace_t0;
+
+static _Thread_local struct TraceBuf *tl_buf;
+
+static uint64_t trace_now_ns(void) {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Starts recording.  Call before any other thread is started.
+ */
+void TraceEnable(void) {
+
+    g_trace_t0 = trace_now_ns();
+    g_trace_on = 1;
+    TraceThreadName("main", -1);
+}
+
+/* the calling thread's buffer, registered on first use */
+static struct TraceBuf *trace_buf(void) {
+
+    struct TraceBuf *buf;
+
+    if (tl_buf) return tl_buf;
+
+    buf = calloc(1, sizeof(struct TraceBuf));
+    if (!buf) {
+        printf("FATAL: Unable to allocate trace buffer\n");
+        exit(-1);
+    }
+    pthread_mutex_lock(&g_trace_lock);
+    buf->tid = g_trace_n_threads++;
+    snprintf(buf->name, TRACE_NAME_MAX, "thread %d", buf->tid);
+    buf->next = g_trace_bufs;
+    g_trace_bufs = buf;
+    pthread_mutex_unlock(&g_trace_lock);
+
+    tl_buf = buf;
+    return buf;
+}
+
+/*
+ * Names the calling thread in the timeline, with idx appended unless
+ * negative.  A thread keeps its first name, so work run on the main
+ * thread does not rename it.
+ */
+void TraceThreadName(const char *name, long idx) {
+
+    struct TraceBuf *buf;
+
+    if (!g_trace_on) return;
+    buf = trace_buf();
+    if (buf->named) return;
+    buf->named = 1;
+    if (idx < 0) {
+        snprintf(buf->name, TRACE_NAME_MAX, "%s", name);
+    } else {
+        snprintf(buf->name, TRACE_NAME_MAX, "%s %ld", name, idx);
+    }
+}
+
+static void trace_event(const char *name, const char *arg_name, long arg, char ph) {
+
+    struct TraceBuf *buf;
+    struct TraceEvent *ev;
+
+    if (!g_trace_on) return;
+    buf = trace_buf();
+
+    if (buf->n == buf->cap) {
+        buf->cap = buf->cap ? 2 * buf->cap : 4096;
+        buf->events = realloc(buf->events, buf->cap * sizeof(struct TraceEvent));
+        if (!buf->events) {
+            printf("FATAL: Unable to allocate trace events\n");
+            exit(-1);
+        }
+    }
+    ev = &buf->events[buf->n++];
+    ev->name = name;
+    ev->arg_name = arg_name;
+    ev->arg = arg;
+    ev->ph = ph;
+    ev->ts_ns = trace_now_ns();
+}
+
+/* begins a span; arg_name, if not NULL, labels the integer arg */
+void TraceBegin(const char *name, const char *arg_name, long arg) {
+
+    trace_event(name, arg_name, arg, 'B');
+}
+
+void TraceEnd(const char *name) {
+
+    trace_event(name, NULL, 0, 'E');
+}
+
+/*
+ * Writes the events of all threads to fname.  The threads must have
+ * finished recording.  Returns -1 if the file cannot be written.
+ */
+int TraceWrite(const char *fname) {
+
+    FILE *fp;
+    struct TraceBuf *buf;
+    struct TraceEvent *ev;
+    unsigned long idx;
+    int first = 1;
+
+    if (!g_trace_on) return 0;
+
+    fp = fopen(fname, "w");
+    if (!fp) {
+        printf("WARNING: Unable to open trace file %s\n", fname);
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (buf = g_trace_bufs; buf; buf = buf->next) {
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", buf->tid, buf->name);
+        first = 0;
+        for (idx = 0; idx < buf->n; ++idx) {
+            ev = &buf->events[idx];
+            fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f",
+                    ev->name, ev->ph, buf->tid, (ev->ts_ns - g_trace_t0) / 1000.0);
+            if (ev->arg_name) {
+                fprintf(fp, ", \"args\": {\"%s\": %ld}", ev->arg_name, ev->arg);
+            }
+            fprintf(fp, "}");
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp)) {
+        printf("WARNING: Unable to write trace file %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Timeline tracing in the Chrome trace event format, which Perfetto and
+ * chrome://tracing open.
+ *
+ * Tracing is compiled in with -DGNAT_TRACE and then switched on at run
+ * time by TraceEnable.  Without GNAT_TRACE the TRACE_ macros expand to
+ * nothing.
+ *
+ * Each thread records begin / end events in its own buffer, so recording
+ * takes no lock after a thread's first event.  TraceWrite writes the
+ * events of all threads once they are done.
+ */
+
+#ifdef GNAT_TRACE
+
+void TraceEnable(void);
+void TraceThreadName(const char *name, long idx);
+void TraceBegin(const char *name, const char *arg_name, long arg);
+void TraceEnd(const char *name);
+int  TraceWrite(const char *fname);
+
+#define TRACE_THREAD_NAME(name, idx)       TraceThreadName((name), (idx))
+#define TRACE_BEGIN(name)                  TraceBegin((name), NULL, 0)
+#define TRACE_BEGIN_ARG(name, arg_name, a) TraceBegin((name), (arg_name), (a))
+#define TRACE_END(name)                    TraceEnd(name)
+
+#else
+
+#define TRACE_THREAD_NAME(name, idx)       ((void)0)
+#define TRACE_BEGIN(name)                  ((void)0)
+#define TRACE_BEGIN_ARG(name, arg_name, a) ((void)0)
+#define TRACE_END(name)                    ((void)0)
+
+#endif
+
+#endif
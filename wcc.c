@@ -0,0 +1,227 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Union-find over spike pairs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "wcc.h"
+
+#define WCC_INIT_CAP 1024
+#define WCC_NO_LABEL ((unsigned long) -1) /* component not labelled yet */
+
+static uint64_t wcc_hash(uint32_t cell, long t1, long t2) {
+
+    uint64_t h = cell * 0x9E3779B97F4A7C15ULL;
+
+    h ^= (uint64_t) t1 + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= (uint64_t) t2 + 0x85EBCA77C2B2AE63ULL + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+struct WCC *WCCCreate(void) {
+
+    struct WCC *res = calloc(1, sizeof(struct WCC));
+    if (!res) {
+        printf("FATAL: Unable to allocate component state\n");
+        exit(-1);
+    }
+    return res;
+}
+
+void WCCDestroy(struct WCC *w) {
+
+    if (!w) return;
+
+    free(w->cell);
+    free(w->t1);
+    free(w->t2);
+    free(w->parent);
+    free(w->rank);
+    free(w->slots);
+    free(w);
+}
+
+/* doubles the hash table and reinserts every node */
+static void wcc_rehash(struct WCC *w) {
+
+    unsigned long n_slots, idx, s;
+
+    n_slots = w->n_slots ? 2 * w->n_slots : 2 * WCC_INIT_CAP;
+    free(w->slots);
+    w->slots = calloc(n_slots, sizeof(unsigned long));
+    if (!w->slots) {
+        printf("FATAL: Unable to allocate component hash table\n");
+        exit(-1);
+    }
+    w->n_slots = n_slots;
+
+    for (idx = 0; idx < w->n_nodes; ++idx) {
+        s = wcc_hash(w->cell[idx], w->t1[idx], w->t2[idx]) & (n_slots - 1);
+        while (w->slots[s]) s = (s + 1) & (n_slots - 1);
+        w->slots[s] = idx + 1;
+    }
+}
+
+static void wcc_grow(struct WCC *w) {
+
+    w->cap = w->cap ? 2 * w->cap : WCC_INIT_CAP;
+    w->cell = realloc(w->cell, w->cap * sizeof(uint32_t));
+    w->t1 = realloc(w->t1, w->cap * sizeof(long));
+    w->t2 = realloc(w->t2, w->cap * sizeof(long));
+    w->parent = realloc(w->parent, w->cap * sizeof(unsigned long));
+    w->rank = realloc(w->rank, w->cap * sizeof(uint32_t));
+    if (!w->cell || !w->t1 || !w->t2 || !w->parent || !w->rank) {
+        printf("FATAL: Unable to allocate component nodes\n");
+        exit(-1);
+    }
+}
+
+/*
+ * Id of spike pair (cell, t1, t2), added as its own component if new
+ */
+unsigned long WCCNode(struct WCC *w, uint32_t cell, long t1, long t2) {
+
+    unsigned long s, id;
+
+    /* keep the table at most half full */
+    if (2 * (w->n_nodes + 1) > w->n_slots) {
+        wcc_rehash(w);
+    }
+
+    s = wcc_hash(cell, t1, t2) & (w->n_slots - 1);
+    while (w->slots[s]) {
+        id = w->slots[s] - 1;
+        if (w->cell[id] == cell && w->t1[id] == t1 && w->t2[id] == t2) {
+            return id;
+        }
+        s = (s + 1) & (w->n_slots - 1);
+    }
+
+    if (w->n_nodes == w->cap) {
+        wcc_grow(w);
+    }
+    id = w->n_nodes++;
+    w->cell[id] = cell;
+    w->t1[id] = t1;
+    w->t2[id] = t2;
+    w->parent[id] = id;
+    w->rank[id] = 0;
+    w->slots[s] = id + 1;
+    return id;
+}
+
+/* root of the component of id, halving the path on the way */
+unsigned long WCCFind(struct WCC *w, unsigned long id) {
+
+    while (w->parent[id] != id) {
+        w->parent[id] = w->parent[w->parent[id]];
+        id = w->parent[id];
+    }
+    return id;
+}
+
+/*
+ * Merges the components of both spike pairs of an edge.
+ * Returns 1 if they were different components, so the edge belongs to
+ * a spanning forest, and 0 otherwise.
+ */
+int WCCAddEdge(struct WCC *w, uint32_t pre_id, long t_pre1, long t_pre2, uint32_t post_id, long t_post1, long t_post2) {
+
+    unsigned long a, b, tmp;
+
+    w->n_edges++;
+    a = WCCFind(w, WCCNode(w, pre_id, t_pre1, t_pre2));
+    b = WCCFind(w, WCCNode(w, post_id, t_post1, t_post2));
+    if (a == b) return 0;
+
+    /* union by rank */
+    if (w->rank[a] < w->rank[b]) {
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+    w->parent[b] = a;
+    if (w->rank[a] == w->rank[b]) w->rank[a]++;
+    w->n_unions++;
+    return 1;
+}
+
+static struct WCC *g_sort_wcc;
+
+static int compare_nodes(const void *pa, const void *pb) {
+
+    unsigned long a = *(const unsigned long *) pa, b = *(const unsigned long *) pb;
+    struct WCC *w = g_sort_wcc;
+
+    if (w->cell[a] != w->cell[b]) return (w->cell[a] < w->cell[b]) ? -1 : 1;
+    if (w->t1[a] != w->t1[b]) return (w->t1[a] < w->t1[b]) ? -1 : 1;
+    if (w->t2[a] != w->t2[b]) return (w->t2[a] < w->t2[b]) ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Writes one line <cell> <t1> <t2> <component> per spike pair, sorted by
+ * spike pair.  Components are numbered from 0 in order of their first
+ * spike pair, so the labels do not depend on the order edges arrived in.
+ * Returns the number of components.
+ */
+unsigned long WCCWriteLabels(struct WCC *w, FILE *fp) {
+
+    unsigned long *order, *label, idx, id, root, n_comp = 0;
+
+    order = malloc((w->n_nodes + 1) * sizeof(unsigned long));
+    label = malloc((w->n_nodes + 1) * sizeof(unsigned long));
+    if (!order || !label) {
+        printf("FATAL: Unable to allocate component labels\n");
+        exit(-1);
+    }
+
+    for (idx = 0; idx < w->n_nodes; ++idx) {
+        order[idx] = idx;
+        label[idx] = WCC_NO_LABEL;
+    }
+    g_sort_wcc = w;
+    qsort(order, w->n_nodes, sizeof(unsigned long), compare_nodes);
+
+    for (idx = 0; idx < w->n_nodes; ++idx) {
+        id = order[idx];
+        root = WCCFind(w, id);
+        if (label[root] == WCC_NO_LABEL) label[root] = n_comp++;
+        fprintf(fp, "%u %ld %ld %lu\n", w->cell[id], w->t1[id], w->t2[id], label[root]);
+    }
+
+    free(order);
+    free(label);
+    return n_comp;
+}
@@ -0,0 +1,70 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WCC_H
+#define WCC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Weakly connected components of the second order graph.
+ *
+ * Nodes are spike pairs (cell, t1, t2), numbered in order of first
+ * appearance through an open addressing hash table.  Edges are merged
+ * into a union-find as they arrive, so the edge list is never stored.
+ * Not thread safe: edges are fed from the single edge writer thread.
+ */
+
+struct WCC {
+
+    unsigned long n_nodes;
+    unsigned long cap;
+
+    /* node keys */
+    uint32_t *cell;
+    long *t1;
+    long *t2;
+
+    /* union-find */
+    unsigned long *parent;
+    uint32_t *rank;
+
+    /* hash table of node id + 1, 0 for an empty slot */
+    unsigned long *slots;
+    unsigned long n_slots; /* power of two */
+
+    unsigned long n_edges;
+    unsigned long n_unions; /* edges that joined two components */
+};
+
+struct WCC   *WCCCreate(void);
+void          WCCDestroy(struct WCC *w);
+unsigned long WCCNode(struct WCC *w, uint32_t cell, long t1, long t2);
+unsigned long WCCFind(struct WCC *w, unsigned long id);
+int           WCCAddEdge(struct WCC *w, uint32_t pre_id, long t_pre1, long t_pre2, uint32_t post_id, long t_post1, long t_post2);
+unsigned long WCCWriteLabels(struct WCC *w, FILE *fp);
+
+#endif
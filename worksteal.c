@@ -0,0 +1,237 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Work-stealing scheduler for the second order edge search
+ *
+ * The cost of a postsynaptic cell grows with the square of its spike
+ * count, so a few bursting cells can dominate the run time.  Cells are
+ * handed out as tasks over ranges of the first post spike sp_a.  A worker
+ * splits any task costlier than the grain size, keeps one half and leaves
+ * the other on its deque where idle workers can steal it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include "worksteal.h"
+
+#define DEQUE_INIT_CAP 64
+
+/*
+ * Estimated cost of a task: the number of (post pair, presynaptic partner)
+ * queries it will issue.  Spike i of an n spike list pairs with the
+ * n - 1 - i spikes after it.
+ */
+double SearchTaskCost(struct SearchTask *t) {
+
+    double n_pairs;
+
+    if (t->n_a == 0) return 0;
+
+    n_pairs = (double)t->n_a * (t->n_spikes - 1)
+            - ((double)t->n_a * t->i_first + (double)t->n_a * (t->n_a - 1) / 2);
+    return n_pairs * t->n_presyn;
+}
+
+/*
+ * Splits task t into two ranges of roughly equal cost.
+ * t keeps the lower range, upper receives the rest.
+ * Returns FALSE if the task cannot be split any further.
+ */
+int SearchTaskSplit(struct SearchTask *t, struct SearchTask *upper) {
+
+    double half, acc;
+    unsigned long k;
+    struct Spike *sp;
+
+    if (t->n_a < 2) return FALSE;
+
+    half = SearchTaskCost(t) / t->n_presyn / 2;
+    acc = 0;
+    sp = t->sp_first;
+    k = 0;
+    while (k < t->n_a - 1) {
+        acc += t->n_spikes - 1 - (t->i_first + k);
+        sp = sp->next;
+        k++;
+        if (acc >= half) break;
+    }
+
+    *upper = *t;
+    upper->sp_first = sp;
+    upper->i_first = t->i_first + k;
+    upper->n_a = t->n_a - k;
+    t->n_a = k;
+    return TRUE;
+}
+
+int SchedInit(struct Scheduler *s, int n_workers, double grain) {
+
+    int idx;
+
+    s->n_workers = n_workers;
+    s->grain = grain;
+    atomic_init(&s->n_pending, 0);
+
+    s->deques = calloc(n_workers, sizeof(struct TaskDeque));
+    if (!s->deques) {
+        printf("FATAL: Unable to allocate task deques\n");
+        exit(-1);
+    }
+
+    for (idx = 0; idx < n_workers; ++idx) {
+        s->deques[idx].tasks = malloc(DEQUE_INIT_CAP * sizeof(struct SearchTask));
+        if (!s->deques[idx].tasks) {
+            printf("FATAL: Unable to allocate task deque\n");
+            exit(-1);
+        }
+        s->deques[idx].cap = DEQUE_INIT_CAP;
+        pthread_mutex_init(&s->deques[idx].lock, NULL);
+    }
+    return 0;
+}
+
+void SchedDestroy(struct Scheduler *s) {
+
+    int idx;
+
+    for (idx = 0; idx < s->n_workers; ++idx) {
+        pthread_mutex_destroy(&s->deques[idx].lock);
+        free(s->deques[idx].tasks);
+    }
+    free(s->deques);
+}
+
+/*
+ * Pushes a task onto the tail of worker's deque
+ */
+void SchedPush(struct Scheduler *s, int worker, struct SearchTask *t) {
+
+    struct TaskDeque *dq = &s->deques[worker];
+
+    atomic_fetch_add(&s->n_pending, 1);
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        if (dq->head > 0) {
+            /* reclaim the space left behind by steals */
+            memmove(dq->tasks, &dq->tasks[dq->head], (dq->tail - dq->head) * sizeof(struct SearchTask));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        } else {
+            dq->cap *= 2;
+            dq->tasks = realloc(dq->tasks, dq->cap * sizeof(struct SearchTask));
+            if (!dq->tasks) {
+                printf("FATAL: Unable to grow task deque\n");
+                exit(-1);
+            }
+        }
+    }
+    dq->tasks[dq->tail++] = *t;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static int SchedPopTail(struct TaskDeque *dq, struct SearchTask *t) {
+
+    int res = FALSE;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *t = dq->tasks[--dq->tail];
+        res = TRUE;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return res;
+}
+
+static int SchedStealHead(struct TaskDeque *dq, struct SearchTask *t) {
+
+    int res = FALSE;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *t = dq->tasks[dq->head++];
+        res = TRUE;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return res;
+}
+
+/*
+ * Fetches the next task for worker, stealing from other workers
+ * when its own deque is empty.  Tasks above the grain size are split
+ * and the upper half is left on the deque for thieves.
+ * Returns FALSE once every task has been completed.
+ */
+int SchedNext(struct Scheduler *s, int worker, struct SearchTask *t) {
+
+    struct TaskDeque *dq = &s->deques[worker];
+    struct SearchTask upper;
+    int found, victim, idx;
+
+    for (;;) {
+        found = SchedPopTail(dq, t);
+
+        for (idx = 1; !found && idx < s->n_workers; ++idx) {
+            victim = (worker + idx) % s->n_workers;
+            if (SchedStealHead(&s->deques[victim], t)) {
+                dq->n_stolen++;
+                found = TRUE;
+            }
+        }
+
+        if (found) break;
+        if (atomic_load(&s->n_pending) == 0) return FALSE;
+        sched_yield();
+    }
+
+    while (SearchTaskCost(t) > s->grain && SearchTaskSplit(t, &upper)) {
+        SchedPush(s, worker, &upper);
+        dq->n_split++;
+    }
+    dq->n_run++;
+    return TRUE;
+}
+
+/*
+ * Marks a task returned by SchedNext as finished
+ */
+void SchedTaskDone(struct Scheduler *s) {
+
+    atomic_fetch_sub(&s->n_pending, 1);
+}
+
+void SchedPrintStats(struct Scheduler *s) {
+
+    int idx;
+
+    for (idx = 0; idx < s->n_workers; ++idx) {
+        printf("Worker %d: %lu tasks run, %lu stolen, %lu split\n", idx,
+               s->deques[idx].n_run, s->deques[idx].n_stolen, s->deques[idx].n_split);
+    }
+}
@@ -0,0 +1,85 @@
+/* 
+ * GNATFinder
+ *
+ * Copyright 2023 National Technology & Engineering Solutions of Sandia, LLC (NTESS). 
+ * Under the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains certain rights in this software.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+ * products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WORKSTEAL_H
+#define WORKSTEAL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "quadtree.h"
+
+/*
+ * A unit of search work: the post spike pairs (sp_a, sp_b) of one
+ * postsynaptic cell whose first spike sp_a lies in a contiguous range
+ * of the cell's spike list.
+ */
+struct SearchTask {
+
+    unsigned long post_idx;  /* postsynaptic cell */
+    struct Spike *sp_first;  /* first sp_a spike of the range */
+    unsigned long i_first;   /* index of sp_first in the cell's spike list */
+    unsigned long n_a;       /* number of sp_a spikes in the range */
+    unsigned long n_spikes;  /* number of spikes of the cell */
+    unsigned long n_presyn;  /* number of presynaptic partners of the cell */
+};
+
+/*
+ * Per-worker double ended task queue.
+ * The owner pushes and pops at the tail, thieves steal from the head.
+ */
+struct TaskDeque {
+
+    struct SearchTask *tasks;
+    unsigned long head;
+    unsigned long tail;
+    unsigned long cap;
+    pthread_mutex_t lock;
+
+    unsigned long n_run;    /* tasks run by the owner */
+    unsigned long n_stolen; /* tasks the owner stole from others */
+    unsigned long n_split;  /* tasks the owner split */
+};
+
+struct Scheduler {
+
+    int n_workers;
+    struct TaskDeque *deques;
+    double grain;           /* tasks costlier than this are split */
+    atomic_ulong n_pending; /* tasks queued or running */
+};
+
+double SearchTaskCost(struct SearchTask *t);
+int    SearchTaskSplit(struct SearchTask *t, struct SearchTask *upper);
+
+int  SchedInit(struct Scheduler *s, int n_workers, double grain);
+void SchedDestroy(struct Scheduler *s);
+void SchedPush(struct Scheduler *s, int worker, struct SearchTask *t);
+int  SchedNext(struct Scheduler *s, int worker, struct SearchTask *t);
+void SchedTaskDone(struct Scheduler *s);
+void SchedPrintStats(struct Scheduler *s);
+
+#endif